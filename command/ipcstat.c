@@ -0,0 +1,178 @@
+#include "stdio.h"
+#include "string.h"
+#include "const.h"
+
+/*
+ * ipcstat [rounds]
+ *
+ * Drain the kernel's IPC trace ring (starting with what is already in it)
+ * every 100 ms for a number of rounds (10 by default) and print, for every
+ * (src, dst, type), a histogram of how long the messages took to be
+ * delivered, in TSC cycles.
+ *
+ * A message handed over directly counts as 0. A blocked send (or a pending
+ * interrupt) is paired with the record of the receiver taking it over.
+ *
+ * At last the depth of the sending queue of every proc that has ever had
+ * a sender waiting is printed.
+ */
+
+#define MAX_PID    64
+#define NR_EDGES   64
+#define NR_BUCKETS 33 /* 0, then [2^(i-1), 2^i) cycles for bucket i */
+#define NR_RECS    64
+
+struct edge {
+    int src;
+    int dst;
+    int type;
+    int nr;
+    int hist[NR_BUCKETS];
+};
+
+struct pending {
+    int valid;
+    int dst;
+    int type;
+    u32 tsc;
+};
+
+static struct edge edges[NR_EDGES];
+static int nr_edges;
+static int nr_dropped; /* edges that didn't fit */
+
+static struct pending pend_send[MAX_PID]; /* blocked senders, by src */
+static struct pending pend_int[MAX_PID];  /* pending interrupts, by dst */
+
+static struct ipc_trace recs[NR_RECS];
+
+static char stat_buf[sizeof(struct proc_stat_hdr) +
+                     MAX_PID * sizeof(struct proc_stat)];
+
+static int bucket(u32 lat) {
+    int b = 0;
+    while (lat) {
+        lat >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static void add(int src, int dst, int type, u32 lat) {
+    int i;
+    for (i = 0; i < nr_edges; i++)
+        if (edges[i].src == src && edges[i].dst == dst &&
+            edges[i].type == type)
+            break;
+
+    if (i == nr_edges) {
+        if (nr_edges == NR_EDGES) {
+            nr_dropped++;
+            return;
+        }
+        nr_edges++;
+        edges[i].src = src;
+        edges[i].dst = dst;
+        edges[i].type = type;
+    }
+
+    edges[i].nr++;
+    edges[i].hist[bucket(lat)]++;
+}
+
+static void account(struct ipc_trace* r) {
+    struct pending* p;
+
+    if (r->dst < 0 || r->dst >= MAX_PID)
+        return;
+
+    if (r->flags & IPC_TR_SEND) {
+        if (!(r->flags & IPC_TR_BLOCKED)) {
+            add(r->src, r->dst, r->type, 0);
+            return;
+        }
+        if (r->flags & IPC_TR_INT) {
+            p = &pend_int[r->dst];
+        } else {
+            if (r->src < 0 || r->src >= MAX_PID)
+                return;
+            p = &pend_send[r->src];
+        }
+        p->valid = 1;
+        p->dst = r->dst;
+        p->type = r->type;
+        p->tsc = r->tsc;
+    } else if ((r->flags & IPC_TR_RECV) && !(r->flags & IPC_TR_BLOCKED)) {
+        if (r->flags & IPC_TR_INT) {
+            p = &pend_int[r->dst];
+        } else {
+            if (r->src < 0 || r->src >= MAX_PID)
+                return;
+            p = &pend_send[r->src];
+        }
+        if (p->valid && p->dst == r->dst) {
+            add(r->src, r->dst, p->type, r->tsc - p->tsc);
+            p->valid = 0;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int rounds = 10;
+    int lost = 0;
+    u32 cursor = 0;
+    u32 expect = 0;
+    int i, j, n;
+
+    if (argc == 2) {
+        rounds = 0;
+        for (i = 0; argv[1][i] >= '0' && argv[1][i] <= '9'; i++)
+            rounds = rounds * 10 + argv[1][i] - '0';
+    }
+
+    while (rounds--) {
+        msleep(100);
+        /* draining leaves records too, so stop once the ring is short */
+        do {
+            n = get_ipc_trace(recs, NR_RECS, &cursor);
+            for (i = 0; i < n; i++) {
+                if (expect && recs[i].seq != expect) {
+                    /* records lost, so are the pairs */
+                    lost += recs[i].seq - expect;
+                    memset(pend_send, 0, sizeof(pend_send));
+                    memset(pend_int, 0, sizeof(pend_int));
+                }
+                expect = recs[i].seq + 1;
+                account(&recs[i]);
+            }
+        } while (n == NR_RECS);
+    }
+
+    printf("src->dst  type      nr  latency (cycles, log2 bucket:nr)\n");
+    for (i = 0; i < nr_edges; i++) {
+        struct edge* e = &edges[i];
+        printf("%3d->%3d %5d %7d ", e->src, e->dst, e->type, e->nr);
+        for (j = 0; j < NR_BUCKETS; j++)
+            if (e->hist[j])
+                printf(" %d:%d", j, e->hist[j]);
+        printf("\n");
+    }
+    if (lost || nr_dropped)
+        printf("%d records lost, %d edges dropped\n", lost, nr_dropped);
+
+    struct proc_stat_hdr* hdr = (struct proc_stat_hdr*)stat_buf;
+    if (get_proc_stat(stat_buf, sizeof(stat_buf)) > 0 &&
+        hdr->version >= 2) {
+        printf("pid  queued  q_len  q_len_max  name\n");
+        for (i = 0; i < hdr->nr; i++) {
+            struct proc_stat* ps =
+                (struct proc_stat*)(stat_buf + sizeof(*hdr) +
+                                    i * hdr->ent_size);
+            if (ps->nr_queued)
+                printf("%3d %7d %6d %10d  %s\n", ps->pid, ps->nr_queued,
+                       ps->q_len, ps->q_len_max, ps->name);
+        }
+    }
+
+    return 0;
+}
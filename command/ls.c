@@ -13,13 +13,23 @@
 //     //printf("%c\n",0);
 //     return 0;
 // }
+#define NR_BATCH_ENTS 16
+
 int main(int args, char* argv[]) {
     int is_f = 0;
+    int is_l = 0;
+    char* path = ".";
     for (int i = 1; i < args; ++i) {
         if (strcmp(argv[i], "-f") == 0) {
             is_f = 1;
             break;
         }
+        else if (strcmp(argv[i], "-l") == 0) {
+            is_l = 1;
+        }
+        else {
+            path = argv[i];
+        }
     }
     if (is_f) {
         char result[500];
@@ -30,14 +40,24 @@ int main(int args, char* argv[]) {
         printf("YSSX__LS:%s\n",result);
         //printf("%c\n",0);
     } else {
-        char result[500];
-        memset(result,0,500);
-        search_dir("/", result);
-        // int a = -1;
-        // a = strlen(result);
-        printf("YSSX__LS:%s\n",result);
-        //printf("%c\n",0);
+        struct dirent ents[NR_BATCH_ENTS];
+        int cursor = 0;
+        int n;
+        printf("YSSX__LS:");
+        while ((n = readdir(path, &cursor, ents, NR_BATCH_ENTS)) > 0) {
+            for (int i = 0; i < n; i++) {
+                if (!is_l) {
+                    printf(" %s", ents[i].d_name);
+                    continue;
+                }
+                int mode = ents[i].d_stat.st_mode & I_TYPE_MASK;
+                printf("\n%c %8d %s",
+                       mode == I_DIRECTORY ? 'd' :
+                       mode == I_CHAR_SPECIAL ? 'c' : '-',
+                       ents[i].d_stat.st_size, ents[i].d_name);
+            }
+        }
+        printf("\n");
     }
     return 0;
 }
-
@@ -0,0 +1,576 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   fs/buffer.c
+ * @brief  Sector buffer cache of FS.
+ * The file contains:
+ *   - init_buffer()
+ *   - getblk()
+ *   - bread()
+ *   - bwrite()
+ *   - bdwrite()
+ *   - brelse()
+ *   - binval()
+ *   - bflush()
+ *   - bsync()
+ *   - bprefetch()
+ *
+ * Metadata sectors (super block, inode-map, sector-map, inodes and dir
+ * entries) are read from the disk only once and then served from memory.
+ * A typical routine looks like this:
+ *
+ *       struct buf * bp = bread(dev, sect_nr);
+ *       ... read or modify bp->b_data ...
+ *       bdwrite(bp);    (only if bp->b_data was modified)
+ *       brelse(bp);
+ *
+ * The cache is write-back: bdwrite() only marks the buffer dirty. Dirty
+ * buffers are put onto the disk by bsync(), which is invoked periodically
+ * (see clock_handler()) and on SYNC requests. The dirty sectors are
+ * submitted to the driver in a row, which merges the adjacent ones into one
+ * disk command. bwrite() is still there for the rare cases in which a
+ * sector must reach the disk at once.
+ *
+ * bprefetch() doesn't wait for its reads. Such a buffer is B_BUSY and held
+ * by the cache itself until somebody gets it by getblk() or bread(), which
+ * waits for the read then, or until the read is reaped to make room for
+ * other requests.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "keyboard.h"
+#include "proto.h"
+#include "hd.h"
+
+PRIVATE struct buf	buf_table[NR_BUF];
+PRIVATE struct buf *	buf_hash[NR_BUF_HASH];
+PRIVATE int		nr_dirty;	/* how many buffers are B_DIRTY */
+
+/* writes submitted by submit_flush() but not waited yet */
+PRIVATE struct buf *	flushing[NR_HD_ASYNC];
+PRIVATE int		flush_req[NR_HD_ASYNC];
+PRIVATE int		nr_flushing;
+
+/**
+ * Buffers whose reads are submitted by bprefetch(), the oldest first. An
+ * entry may have been waited already by getblk(), then it is just skipped.
+ * The entries and nr_flushing are at most NR_HD_ASYNC in all.
+ */
+PRIVATE struct buf *	reading[NR_HD_ASYNC];
+PRIVATE int		read_head;	/* the oldest entry */
+PRIVATE int		nr_reading;
+
+/**
+ * Head of the LRU list. lru.b_next is the least recently released buffer,
+ * lru.b_prev is the most recently released one.
+ */
+PRIVATE struct buf	lru;
+
+#define	BUF_HASH(dev,sect_nr)	((((u32)(dev) << 4) ^ (u32)(sect_nr)) & \
+				 (NR_BUF_HASH - 1))
+
+PRIVATE struct buf *	find_buf	(int dev, int sect_nr);
+PRIVATE void		write_buf	(struct buf * bp);
+PRIVATE void		submit_flush	(struct buf * bp);
+PRIVATE void		wait_flush	();
+PRIVATE void		wait_read	(struct buf * bp);
+PRIVATE void		reap_read	();
+PRIVATE void		unhash_buf	(struct buf * bp);
+PRIVATE void		lru_remove	(struct buf * bp);
+PRIVATE void		lru_append	(struct buf * bp);
+
+/*****************************************************************************
+ *                                init_buffer
+ *****************************************************************************/
+/**
+ * <Ring 1> Initialize the buffer cache. All buffers are free and linked into
+ * the LRU list.
+ *****************************************************************************/
+PUBLIC void init_buffer()
+{
+	int i;
+
+	assert(NR_BUF * SECTOR_SIZE <= BCACHE_SIZE);
+
+	for (i = 0; i < NR_BUF_HASH; i++)
+		buf_hash[i] = 0;
+
+	lru.b_next = lru.b_prev = &lru;
+	nr_dirty = 0;
+	nr_flushing = 0;
+	read_head = 0;
+	nr_reading = 0;
+
+	for (i = 0; i < NR_BUF; i++) {
+		struct buf * bp = &buf_table[i];
+		bp->b_dev	= NO_DEV;
+		bp->b_sect	= 0;
+		bp->b_flags	= 0;
+		bp->b_cnt	= 0;
+		bp->b_data	= bcache + i * SECTOR_SIZE;
+		bp->b_hnext	= 0;
+		lru_append(bp);
+	}
+}
+
+/*****************************************************************************
+ *                                getblk
+ *****************************************************************************/
+/**
+ * <Ring 1> Get the buffer of a sector without reading it. If the sector is
+ * not cached, the least recently used buffer is recycled for it and the
+ * buffer is returned with B_VALID cleared.
+ *
+ * Use it instead of bread() if the whole sector is going to be overwritten.
+ *
+ * @param dev      Device nr.
+ * @param sect_nr  Sector nr. in the device.
+ *
+ * @return Ptr to the buffer, which must be released by brelse().
+ *****************************************************************************/
+PUBLIC struct buf * getblk(int dev, int sect_nr)
+{
+	struct buf * bp = find_buf(dev, sect_nr);
+
+	if (bp) {
+		if (bp->b_cnt++ == 0)
+			lru_remove(bp);
+		if (bp->b_flags & B_BUSY)
+			wait_read(bp);
+		return bp;
+	}
+
+	bp = lru.b_next;
+	if (bp == &lru)
+		panic("no free buffer in the buffer cache");
+	lru_remove(bp);
+
+	if (bp->b_flags & B_DIRTY)
+		write_buf(bp);
+
+	if (bp->b_dev != NO_DEV)
+		unhash_buf(bp);
+
+	bp->b_dev	= dev;
+	bp->b_sect	= sect_nr;
+	bp->b_flags	= 0;
+	bp->b_cnt	= 1;
+
+	int h = BUF_HASH(dev, sect_nr);
+	bp->b_hnext = buf_hash[h];
+	buf_hash[h] = bp;
+
+	return bp;
+}
+
+/*****************************************************************************
+ *                                bread
+ *****************************************************************************/
+/**
+ * <Ring 1> Get the buffer of a sector. The sector is read from the disk only
+ * if it is not in the cache.
+ *
+ * @param dev      Device nr.
+ * @param sect_nr  Sector nr. in the device.
+ *
+ * @return Ptr to the buffer, which must be released by brelse().
+ *****************************************************************************/
+PUBLIC struct buf * bread(int dev, int sect_nr)
+{
+	struct buf * bp = getblk(dev, sect_nr);
+
+	if (!(bp->b_flags & B_VALID)) {
+		rw_sector(DEV_READ,
+			  dev,
+			  (u64)sect_nr * SECTOR_SIZE,
+			  SECTOR_SIZE,
+			  TASK_FS,
+			  bp->b_data);
+		bp->b_flags |= B_VALID;
+	}
+
+	return bp;
+}
+
+/*****************************************************************************
+ *                                bwrite
+ *****************************************************************************/
+/**
+ * <Ring 1> Write a buffer to the disk at once. The caller still holds the
+ * buffer.
+ *
+ * @param bp  Ptr to the buffer.
+ *****************************************************************************/
+PUBLIC void bwrite(struct buf * bp)
+{
+	assert(bp->b_cnt > 0);
+
+	bp->b_flags |= B_VALID;
+	write_buf(bp);
+}
+
+/*****************************************************************************
+ *                                bdwrite
+ *****************************************************************************/
+/**
+ * <Ring 1> Delayed write: mark a buffer dirty. The sector will be written to
+ * the disk by bsync() or bflush(), or when the buffer is recycled. The
+ * caller still holds the buffer.
+ *
+ * @param bp  Ptr to the buffer.
+ *****************************************************************************/
+PUBLIC void bdwrite(struct buf * bp)
+{
+	assert(bp->b_cnt > 0);
+
+	if (!(bp->b_flags & B_DIRTY))
+		nr_dirty++;
+	bp->b_flags |= B_VALID | B_DIRTY;
+}
+
+/*****************************************************************************
+ *                                brelse
+ *****************************************************************************/
+/**
+ * <Ring 1> Release a buffer got by getblk() or bread(). The sector stays in
+ * the cache until the buffer is recycled.
+ *
+ * @param bp  Ptr to the buffer.
+ *****************************************************************************/
+PUBLIC void brelse(struct buf * bp)
+{
+	assert(bp->b_cnt > 0);
+
+	if (--bp->b_cnt == 0)
+		lru_append(bp);
+}
+
+/*****************************************************************************
+ *                                binval
+ *****************************************************************************/
+/**
+ * <Ring 1> Drop the cached copies of some sectors. It must be invoked after
+ * the sectors are written to the disk without going through the cache.
+ *
+ * @param dev       Device nr.
+ * @param sect_nr   The 1st sector.
+ * @param nr_sects  How many sectors.
+ *****************************************************************************/
+PUBLIC void binval(int dev, int sect_nr, int nr_sects)
+{
+	struct buf * bp;
+	int i;
+
+	for (i = 0; i < NR_BUF; i++) {
+		bp = &buf_table[i];
+		if (bp->b_dev != dev ||
+		    bp->b_sect < sect_nr ||
+		    bp->b_sect >= sect_nr + nr_sects)
+			continue;
+
+		if (bp->b_flags & B_BUSY)
+			wait_read(bp);
+
+		assert(bp->b_cnt == 0);
+		if (bp->b_flags & B_DIRTY)
+			nr_dirty--;
+		unhash_buf(bp);
+		bp->b_dev = NO_DEV;
+		bp->b_flags = 0;
+
+		/* recycle it before any other buffer */
+		lru_remove(bp);
+		bp->b_prev = &lru;
+		bp->b_next = lru.b_next;
+		lru.b_next->b_prev = bp;
+		lru.b_next = bp;
+	}
+}
+
+/*****************************************************************************
+ *                                bflush
+ *****************************************************************************/
+/**
+ * <Ring 1> Write the dirty buffers of some sectors to the disk. It must be
+ * invoked before the sectors are read from the disk without going through
+ * the cache.
+ *
+ * @param dev       Device nr.
+ * @param sect_nr   The 1st sector.
+ * @param nr_sects  How many sectors.
+ *****************************************************************************/
+PUBLIC void bflush(int dev, int sect_nr, int nr_sects)
+{
+	int i;
+
+	for (i = 0; i < nr_sects && nr_dirty > nr_flushing; i++) {
+		struct buf * bp = find_buf(dev, sect_nr + i);
+		if (bp && (bp->b_flags & B_DIRTY))
+			submit_flush(bp);
+	}
+	wait_flush();
+}
+
+/*****************************************************************************
+ *                                bsync
+ *****************************************************************************/
+/**
+ * <Ring 1> Write all dirty buffers to the disk.
+ *****************************************************************************/
+PUBLIC void bsync()
+{
+	int i;
+
+	/* the driver keeps the done reads until they are waited */
+	while (nr_reading)
+		reap_read();
+
+	for (i = 0; i < NR_BUF && nr_dirty > nr_flushing; i++)
+		if (buf_table[i].b_flags & B_DIRTY)
+			submit_flush(&buf_table[i]);
+	wait_flush();
+}
+
+/*****************************************************************************
+ *                                bprefetch
+ *****************************************************************************/
+/**
+ * <Ring 1> Start reading some sectors into the cache, without waiting. The
+ * ones not cached yet are submitted to the driver in a row, so that the
+ * driver reads them with as few disk commands as possible. The caller goes
+ * on while the disk works, a later getblk() or bread() of such a sector
+ * waits for it.
+ *
+ * @param dev       Device nr.
+ * @param sect_nr   The 1st sector.
+ * @param nr_sects  How many sectors.
+ *****************************************************************************/
+PUBLIC void bprefetch(int dev, int sect_nr, int nr_sects)
+{
+	int i;
+
+	for (i = 0; i < nr_sects; i++) {
+		struct buf * bp = getblk(dev, sect_nr + i);
+
+		if (bp->b_flags & B_VALID) {
+			brelse(bp);
+			continue;
+		}
+
+		if (nr_reading + nr_flushing == NR_HD_ASYNC) {
+			if (nr_reading)
+				reap_read();
+			else
+				wait_flush();
+		}
+
+		/* the buffer stays held until the read is waited */
+		bp->b_flags |= B_BUSY;
+		bp->b_req = rw_sector_async(DEV_READ,
+					    dev,
+					    (u64)(sect_nr + i) * SECTOR_SIZE,
+					    SECTOR_SIZE,
+					    TASK_FS,
+					    bp->b_data);
+		reading[(read_head + nr_reading) % NR_HD_ASYNC] = bp;
+		nr_reading++;
+	}
+}
+
+/*****************************************************************************
+ *                                wait_read
+ *****************************************************************************/
+/**
+ * <Ring 1> Wait for the read of a B_BUSY buffer submitted by bprefetch(),
+ * then drop the hold bprefetch() has on it.
+ *
+ * @param bp  Ptr to the buffer.
+ *****************************************************************************/
+PRIVATE void wait_read(struct buf * bp)
+{
+	assert(bp->b_flags & B_BUSY);
+
+	rw_sector_wait(bp->b_dev, bp->b_req);
+	bp->b_flags = (bp->b_flags & ~B_BUSY) | B_VALID;
+	brelse(bp);
+}
+
+/*****************************************************************************
+ *                                reap_read
+ *****************************************************************************/
+/**
+ * <Ring 1> Wait for the oldest read submitted by bprefetch(), unless it has
+ * been waited already.
+ *****************************************************************************/
+PRIVATE void reap_read()
+{
+	struct buf * bp = reading[read_head];
+
+	assert(nr_reading > 0);
+	read_head = (read_head + 1) % NR_HD_ASYNC;
+	nr_reading--;
+
+	if (bp->b_flags & B_BUSY)
+		wait_read(bp);
+}
+
+/*****************************************************************************
+ *                                write_buf
+ *****************************************************************************/
+/**
+ * <Ring 1> Write the sector of a single buffer to the disk.
+ *
+ * @param bp  Ptr to the buffer.
+ *****************************************************************************/
+PRIVATE void write_buf(struct buf * bp)
+{
+	rw_sector(DEV_WRITE,
+		  bp->b_dev,
+		  (u64)bp->b_sect * SECTOR_SIZE,
+		  SECTOR_SIZE,
+		  TASK_FS,
+		  bp->b_data);
+
+	if (bp->b_flags & B_DIRTY) {
+		bp->b_flags &= ~B_DIRTY;
+		nr_dirty--;
+	}
+}
+
+/*****************************************************************************
+ *                                submit_flush
+ *****************************************************************************/
+/**
+ * <Ring 1> Submit the write of a dirty buffer to the driver without waiting
+ * for it. The driver sorts the submitted writes and merges the adjacent
+ * ones into one disk command, so there is no need to assemble the sectors
+ * here.
+ *
+ * @param bp  Ptr to the dirty buffer.
+ *****************************************************************************/
+PRIVATE void submit_flush(struct buf * bp)
+{
+	assert(bp->b_flags & B_DIRTY);
+
+	if (nr_flushing + nr_reading == NR_HD_ASYNC) {
+		if (nr_reading)
+			reap_read();
+		else
+			wait_flush();
+	}
+
+	flushing[nr_flushing] = bp;
+	flush_req[nr_flushing] = rw_sector_async(DEV_WRITE,
+						 bp->b_dev,
+						 (u64)bp->b_sect * SECTOR_SIZE,
+						 SECTOR_SIZE,
+						 TASK_FS,
+						 bp->b_data);
+	nr_flushing++;
+}
+
+/*****************************************************************************
+ *                                wait_flush
+ *****************************************************************************/
+/**
+ * <Ring 1> Wait for all the writes submitted by submit_flush(), then the
+ * buffers are clean.
+ *****************************************************************************/
+PRIVATE void wait_flush()
+{
+	int i;
+
+	for (i = 0; i < nr_flushing; i++) {
+		struct buf * bp = flushing[i];
+		rw_sector_wait(bp->b_dev, flush_req[i]);
+		bp->b_flags &= ~B_DIRTY;
+		nr_dirty--;
+	}
+	nr_flushing = 0;
+}
+
+/*****************************************************************************
+ *                                find_buf
+ *****************************************************************************/
+/**
+ * <Ring 1> Look up the hash table for a sector.
+ *
+ * @param dev      Device nr.
+ * @param sect_nr  Sector nr. in the device.
+ *
+ * @return Ptr to the buffer if the sector is cached, otherwise zero.
+ *****************************************************************************/
+PRIVATE struct buf * find_buf(int dev, int sect_nr)
+{
+	struct buf * bp = buf_hash[BUF_HASH(dev, sect_nr)];
+
+	for (; bp; bp = bp->b_hnext)
+		if (bp->b_dev == dev && bp->b_sect == sect_nr)
+			return bp;
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                unhash_buf
+ *****************************************************************************/
+/**
+ * <Ring 1> Remove a buffer from its hash chain.
+ *
+ * @param bp  Ptr to the buffer.
+ *****************************************************************************/
+PRIVATE void unhash_buf(struct buf * bp)
+{
+	struct buf ** pp = &buf_hash[BUF_HASH(bp->b_dev, bp->b_sect)];
+
+	for (; *pp; pp = &(*pp)->b_hnext) {
+		if (*pp == bp) {
+			*pp = bp->b_hnext;
+			bp->b_hnext = 0;
+			return;
+		}
+	}
+
+	assert(0);
+}
+
+/*****************************************************************************
+ *                                lru_remove
+ *****************************************************************************/
+/**
+ * <Ring 1> Unlink a buffer from the LRU list.
+ *
+ * @param bp  Ptr to the buffer.
+ *****************************************************************************/
+PRIVATE void lru_remove(struct buf * bp)
+{
+	bp->b_prev->b_next = bp->b_next;
+	bp->b_next->b_prev = bp->b_prev;
+	bp->b_prev = bp->b_next = 0;
+}
+
+/*****************************************************************************
+ *                                lru_append
+ *****************************************************************************/
+/**
+ * <Ring 1> Put a buffer at the tail (the most recently used end) of the LRU
+ * list.
+ *
+ * @param bp  Ptr to the buffer.
+ *****************************************************************************/
+PRIVATE void lru_append(struct buf * bp)
+{
+	bp->b_next = &lru;
+	bp->b_prev = lru.b_prev;
+	lru.b_prev->b_next = bp;
+	lru.b_prev = bp;
+}
@@ -0,0 +1,269 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   fs/dcache.c
+ * @brief  Directory entry name cache.
+ * The file contains:
+ *   - init_dcache()
+ *   - dcache_lookup()
+ *   - dcache_enter()
+ *   - dcache_purge()
+ *
+ * search_file() asks the cache before it reads the directory, and tells the
+ * cache what it has found. A name which is not in the directory is cached
+ * as well (with inode nr 0), so looking for a missing file again costs no
+ * disk I/O either. Whoever adds or removes a directory entry must update
+ * the cache by dcache_enter(), and whoever removes a directory must drop
+ * its names by dcache_purge().
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+/**
+ * @struct dcache_entry
+ * @brief  A cached directory entry.
+ */
+struct dcache_entry {
+	int	dev;			/**< Device of the directory */
+	int	dir_nr;			/**< I-node nr of the directory, 0 if free */
+	char	name[MAX_FILENAME_LEN];	/**< Filename, padded with 0 */
+	int	inode_nr;		/**< I-node nr of the file, 0 if absent */
+
+	struct dcache_entry *	hnext;	/**< next in the hash chain */
+	struct dcache_entry *	prev;	/**< prev in the LRU list */
+	struct dcache_entry *	next;	/**< next in the LRU list */
+};
+
+PRIVATE struct dcache_entry	dcache[NR_DCACHE];
+PRIVATE struct dcache_entry *	dcache_hash[NR_DCACHE_HASH];
+
+/**
+ * Head of the LRU list. dc_lru.next is the least recently used entry,
+ * dc_lru.prev is the most recently used one.
+ */
+PRIVATE struct dcache_entry	dc_lru;
+
+PRIVATE int			name_hash	(int dev, int dir_nr,
+						 const char * name);
+PRIVATE struct dcache_entry *	find_entry	(struct inode * dir_inode,
+						 const char * name);
+PRIVATE void			unhash_entry	(struct dcache_entry * de);
+PRIVATE void			touch_entry	(struct dcache_entry * de);
+
+/*****************************************************************************
+ *                                init_dcache
+ *****************************************************************************/
+/**
+ * <Ring 1> Initialize the name cache. All entries are free.
+ *****************************************************************************/
+PUBLIC void init_dcache()
+{
+	int i;
+
+	memset(dcache, 0, sizeof(dcache));
+	memset(dcache_hash, 0, sizeof(dcache_hash));
+
+	dc_lru.prev = dc_lru.next = &dc_lru;
+	for (i = 0; i < NR_DCACHE; i++) {
+		struct dcache_entry * de = &dcache[i];
+		de->next = &dc_lru;
+		de->prev = dc_lru.prev;
+		dc_lru.prev->next = de;
+		dc_lru.prev = de;
+	}
+}
+
+/*****************************************************************************
+ *                                dcache_lookup
+ *****************************************************************************/
+/**
+ * <Ring 1> Look up the name cache.
+ *
+ * @param[in]  dir_inode  I-node of the directory.
+ * @param[in]  name       Filename.
+ * @param[out] inode_nr   I-node nr of the file, 0 if the file is known to
+ *                        be absent.
+ *
+ * @return Nonzero if the name is cached.
+ *****************************************************************************/
+PUBLIC int dcache_lookup(struct inode * dir_inode, const char * name,
+			 int * inode_nr)
+{
+	struct dcache_entry * de = find_entry(dir_inode, name);
+
+	if (!de)
+		return 0;
+
+	touch_entry(de);
+	*inode_nr = de->inode_nr;
+	return 1;
+}
+
+/*****************************************************************************
+ *                                dcache_enter
+ *****************************************************************************/
+/**
+ * <Ring 1> Record the inode nr of a name, replacing what has been cached
+ * for the name. The least recently used entry is recycled for a new name.
+ *
+ * @param dir_inode  I-node of the directory.
+ * @param name       Filename.
+ * @param inode_nr   I-node nr of the file, 0 if the file is absent.
+ *****************************************************************************/
+PUBLIC void dcache_enter(struct inode * dir_inode, const char * name,
+			 int inode_nr)
+{
+	struct dcache_entry * de = find_entry(dir_inode, name);
+
+	if (!de) {
+		de = dc_lru.next;
+		if (de->dir_nr)
+			unhash_entry(de);
+
+		de->dev = dir_inode->i_dev;
+		de->dir_nr = dir_inode->i_num;
+		pad_name(de->name, name);
+
+		int h = name_hash(de->dev, de->dir_nr, de->name);
+		de->hnext = dcache_hash[h];
+		dcache_hash[h] = de;
+	}
+
+	de->inode_nr = inode_nr;
+	touch_entry(de);
+}
+
+/*****************************************************************************
+ *                                dcache_purge
+ *****************************************************************************/
+/**
+ * <Ring 1> Drop all the cached names of a directory, which is going away.
+ * Its inode nr may be reused by another directory.
+ *
+ * @param dir_inode  I-node of the directory.
+ *****************************************************************************/
+PUBLIC void dcache_purge(struct inode * dir_inode)
+{
+	int i;
+
+	for (i = 0; i < NR_DCACHE; i++) {
+		struct dcache_entry * de = &dcache[i];
+		if (de->dev != dir_inode->i_dev || de->dir_nr != dir_inode->i_num)
+			continue;
+
+		unhash_entry(de);
+		de->dir_nr = 0;
+
+		/* recycle it before any other entry */
+		de->prev->next = de->next;
+		de->next->prev = de->prev;
+		de->prev = &dc_lru;
+		de->next = dc_lru.next;
+		dc_lru.next->prev = de;
+		dc_lru.next = de;
+	}
+}
+
+/*****************************************************************************
+ *                                name_hash
+ *****************************************************************************/
+/**
+ * <Ring 1> Hash a name in a directory.
+ *
+ * @param dev     Device of the directory.
+ * @param dir_nr  I-node nr of the directory.
+ * @param name    Filename padded with 0.
+ *
+ * @return Index into dcache_hash[].
+ *****************************************************************************/
+PRIVATE int name_hash(int dev, int dir_nr, const char * name)
+{
+	u32 h = (u32)dev * 31 + dir_nr;
+	int i;
+
+	for (i = 0; i < MAX_FILENAME_LEN && name[i]; i++)
+		h = h * 31 + (u8)name[i];
+
+	return h & (NR_DCACHE_HASH - 1);
+}
+
+/*****************************************************************************
+ *                                find_entry
+ *****************************************************************************/
+/**
+ * <Ring 1> Look up the hash table for a name.
+ *
+ * @param dir_inode  I-node of the directory.
+ * @param name       Filename.
+ *
+ * @return Ptr to the entry if the name is cached, otherwise zero.
+ *****************************************************************************/
+PRIVATE struct dcache_entry * find_entry(struct inode * dir_inode,
+					 const char * name)
+{
+	char key[MAX_FILENAME_LEN];
+	pad_name(key, name);
+
+	struct dcache_entry * de =
+		dcache_hash[name_hash(dir_inode->i_dev, dir_inode->i_num, key)];
+	for (; de; de = de->hnext)
+		if (de->dev == dir_inode->i_dev &&
+		    de->dir_nr == dir_inode->i_num &&
+		    memcmp(de->name, key, MAX_FILENAME_LEN) == 0)
+			return de;
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                unhash_entry
+ *****************************************************************************/
+/**
+ * <Ring 1> Remove an entry from its hash chain.
+ *
+ * @param de  The entry.
+ *****************************************************************************/
+PRIVATE void unhash_entry(struct dcache_entry * de)
+{
+	struct dcache_entry ** pp =
+		&dcache_hash[name_hash(de->dev, de->dir_nr, de->name)];
+	for (; *pp; pp = &(*pp)->hnext) {
+		if (*pp == de) {
+			*pp = de->hnext;
+			de->hnext = 0;
+			return;
+		}
+	}
+
+	assert(0);
+}
+
+/*****************************************************************************
+ *                                touch_entry
+ *****************************************************************************/
+/**
+ * <Ring 1> Move an entry to the tail (the most recently used end) of the
+ * LRU list.
+ *
+ * @param de  The entry.
+ *****************************************************************************/
+PRIVATE void touch_entry(struct dcache_entry * de)
+{
+	de->prev->next = de->next;
+	de->next->prev = de->prev;
+
+	de->next = &dc_lru;
+	de->prev = dc_lru.prev;
+	dc_lru.prev->next = de;
+	dc_lru.prev = de;
+}
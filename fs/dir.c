@@ -0,0 +1,513 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   fs/dir.c
+ * @brief  Hashed directories.
+ * The file contains:
+ *   - dir_lookup()
+ *   - dir_add()
+ *   - dir_remove()
+ *   - dir_is_empty()
+ *   - init_dir()
+ *   - clear_dir()
+ *   - pad_name()
+ *
+ * See NR_DIR_BUCKETS for the layout of a directory. Looking up a name
+ * reads the head sector and the bucket of the name (rarely the buckets
+ * after it), no matter how many entries the directory has.
+ *
+ * The in-memory i-node of a directory counts its live entries, the removed
+ * entries left in the buckets and the free entries in the head sector (see
+ * index_dir()). With them dir_add() knows whether to look at the head
+ * sector at all, and dir_remove() knows when the removed entries have made
+ * the probe sequences long enough to be worth a rehash().
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE struct dir_entry * lookup_entry(struct inode * dir, const char * key,
+					struct buf ** pbp, int * pblk);
+PRIVATE int insert_bucket(struct inode * dir, char * key, int inode_nr);
+PRIVATE int rehash(struct inode * dir, int nr_sects);
+PRIVATE void index_dir(struct inode * dir);
+PRIVATE void zero_dir_blks(struct inode * dir, int from, int to);
+PRIVATE struct buf * read_dir_blk(struct inode * dir, int blk);
+PRIVATE int nr_buckets(struct inode * dir);
+PRIVATE int dir_hash(struct inode * dir, const char * key);
+
+/*****************************************************************************
+ *                                dir_lookup
+ *****************************************************************************/
+/**
+ * Look up a name in a directory. The name cache is asked first.
+ *
+ * @param dir   I-node of the directory.
+ * @param name  Filename.
+ *
+ * @return The inode nr of the file, zero if there is no such a file.
+ *****************************************************************************/
+PUBLIC int dir_lookup(struct inode * dir, const char * name)
+{
+	int inode_nr;
+
+	if (dcache_lookup(dir, name, &inode_nr))
+		return inode_nr;
+
+	char key[MAX_FILENAME_LEN];
+	pad_name(key, name);
+
+	struct buf * bp;
+	int blk;
+	struct dir_entry * pde = lookup_entry(dir, key, &bp, &blk);
+
+	inode_nr = 0;
+	if (pde) {
+		inode_nr = pde->inode_nr;
+		brelse(bp);
+	}
+
+	dcache_enter(dir, name, inode_nr);
+	return inode_nr;
+}
+
+/*****************************************************************************
+ *                                dir_add
+ *****************************************************************************/
+/**
+ * Write a new entry into a directory. The name must not be there yet.
+ *
+ * @param dir       I-node of the directory.
+ * @param name      Filename.
+ * @param inode_nr  I-node nr of the file.
+ *
+ * @return Zero if successful, -1 if the directory is full.
+ *****************************************************************************/
+PUBLIC int dir_add(struct inode * dir, const char * name, int inode_nr)
+{
+	char key[MAX_FILENAME_LEN];
+	pad_name(key, name);
+
+	index_dir(dir);
+
+	if (dir->i_head_free) {
+		struct buf * bp = read_dir_blk(dir, 0);
+		struct dir_entry * pde = (struct dir_entry *)bp->b_data;
+		int i;
+
+		for (i = 0; i < DIR_ENTS_PER_SECT; i++, pde++)
+			if (pde->inode_nr == 0)
+				break;
+		assert(i < DIR_ENTS_PER_SECT);
+
+		pde->inode_nr = inode_nr;
+		memcpy(pde->name, key, MAX_FILENAME_LEN);
+		bdwrite(bp);
+		brelse(bp);
+		dir->i_head_free--;
+	}
+	else if (insert_bucket(dir, key, inode_nr) != 0) {
+		/* the buckets are full, double them */
+		int nr_sects = dir->i_size / SECTOR_SIZE * 2;
+		if (nr_sects > MAX_DIR_SECTS ||
+		    rehash(dir, nr_sects) != 0 ||
+		    insert_bucket(dir, key, inode_nr) != 0)
+			return -1;
+	}
+
+	dir->i_nr_ents++;
+	dcache_enter(dir, name, inode_nr);
+	return 0;
+}
+
+/*****************************************************************************
+ *                                dir_remove
+ *****************************************************************************/
+/**
+ * Remove an entry from a directory.
+ *
+ * @param dir   I-node of the directory.
+ * @param name  Filename.
+ *
+ * @return Zero if successful, -1 if there is no such an entry.
+ *****************************************************************************/
+PUBLIC int dir_remove(struct inode * dir, const char * name)
+{
+	char key[MAX_FILENAME_LEN];
+	pad_name(key, name);
+
+	struct buf * bp;
+	int blk;
+	struct dir_entry * pde = lookup_entry(dir, key, &bp, &blk);
+
+	if (!pde)
+		return -1;
+
+	index_dir(dir);
+
+	if (blk == 0) {
+		memset(pde, 0, DIR_ENTRY_SIZE);
+		dir->i_head_free++;
+	}
+	else {
+		pde->inode_nr = 0; /* the name tells it is not a fresh slot */
+		dir->i_nr_tombs++;
+	}
+	bdwrite(bp);
+	brelse(bp);
+	dir->i_nr_ents--;
+
+	dcache_enter(dir, name, 0);
+
+	/* rehash once the removed entries outnumber the live ones */
+	int nr_live = dir->i_nr_ents - (DIR_ENTS_PER_SECT - dir->i_head_free);
+	if (dir->i_nr_tombs >= DIR_ENTS_PER_SECT && dir->i_nr_tombs > nr_live)
+		rehash(dir, dir->i_size / SECTOR_SIZE);
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                dir_is_empty
+ *****************************************************************************/
+/**
+ * Check whether a directory has nothing but `.' and `..'.
+ *
+ * @param dir  I-node of the directory.
+ *
+ * @return Nonzero if the directory is empty.
+ *****************************************************************************/
+PUBLIC int dir_is_empty(struct inode * dir)
+{
+	index_dir(dir);
+	return dir->i_nr_ents <= 2;
+}
+
+/*****************************************************************************
+ *                                init_dir
+ *****************************************************************************/
+/**
+ * Make an empty directory out of a new i-node: allocate and clear the
+ * sectors, then add `.' and `..'.
+ *
+ * @param dir        I-node of the new directory.
+ * @param parent_nr  I-node nr of the parent directory.
+ *
+ * @return Zero if successful, -1 if the device is full.
+ *****************************************************************************/
+PUBLIC int init_dir(struct inode * dir, int parent_nr)
+{
+	if (clear_dir(dir, DIR_SECTS) != 0)
+		return -1;
+
+	dir_add(dir, ".", dir->i_num);
+	dir_add(dir, "..", parent_nr);
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                clear_dir
+ *****************************************************************************/
+/**
+ * Turn a file into a directory without any entry: allocate and clear the
+ * sectors, then set the size.
+ *
+ * @param dir       I-node of the directory.
+ * @param nr_sects  How many sectors the directory has.
+ *
+ * @return Zero if successful, -1 if the device is full.
+ *****************************************************************************/
+PUBLIC int clear_dir(struct inode * dir, int nr_sects)
+{
+	if (extend_file(dir, nr_sects) < nr_sects)
+		return -1;
+
+	zero_dir_blks(dir, 0, nr_sects);
+
+	dir->i_size = nr_sects * SECTOR_SIZE;
+	sync_inode(dir);
+
+	dir->i_nr_ents = 0;
+	dir->i_nr_tombs = 0;
+	dir->i_head_free = DIR_ENTS_PER_SECT;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                pad_name
+ *****************************************************************************/
+/**
+ * Copy a filename into a MAX_FILENAME_LEN key, padding it with 0, the way
+ * it is stored in struct dir_entry::name.
+ *
+ * @param dst  The key.
+ * @param src  The filename.
+ *****************************************************************************/
+PUBLIC void pad_name(char * dst, const char * src)
+{
+	int i;
+
+	for (i = 0; i < MAX_FILENAME_LEN && src[i]; i++)
+		dst[i] = src[i];
+	for (; i < MAX_FILENAME_LEN; i++)
+		dst[i] = 0;
+}
+
+/*****************************************************************************
+ *                                lookup_entry
+ *****************************************************************************/
+/**
+ * Find the entry of a name: in the head sector, or in the bucket of the
+ * name and the ones after it, until a bucket which has never overflowed.
+ *
+ * @param[in]  dir   I-node of the directory.
+ * @param[in]  key   Filename padded by pad_name().
+ * @param[out] pbp   The buffer holding the entry, to be released by the
+ *                   caller.
+ * @param[out] pblk  Sector index of the entry in the directory.
+ *
+ * @return Ptr to the entry, zero if the name is not found.
+ *****************************************************************************/
+PRIVATE struct dir_entry * lookup_entry(struct inode * dir, const char * key,
+					struct buf ** pbp, int * pblk)
+{
+	int nr = nr_buckets(dir);
+	int blk = 0;
+	int i, j;
+
+	for (i = 0; i <= nr; i++) {
+		struct buf * bp = read_dir_blk(dir, blk);
+		struct dir_entry * pde = (struct dir_entry *)bp->b_data;
+		int fresh = 0;
+
+		for (j = 0; j < DIR_ENTS_PER_SECT; j++, pde++) {
+			if (pde->inode_nr &&
+			    memcmp(pde->name, key, MAX_FILENAME_LEN) == 0) {
+				*pbp = bp;
+				*pblk = blk;
+				return pde;
+			}
+			if (pde->inode_nr == 0 && pde->name[0] == 0)
+				fresh = 1;
+		}
+		brelse(bp);
+
+		if (i > 0 && fresh) /* the name cannot be in the next bucket */
+			break;
+
+		blk = (i == 0) ? dir_hash(dir, key) : blk % nr + 1;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                insert_bucket
+ *****************************************************************************/
+/**
+ * Write an entry into the first free slot of the bucket of the name or the
+ * buckets after it. A removed entry is as good as a fresh one.
+ *
+ * @param dir       I-node of the directory.
+ * @param key       Filename padded by pad_name().
+ * @param inode_nr  I-node nr of the file.
+ *
+ * @return Zero if successful, -1 if all the buckets are full.
+ *****************************************************************************/
+PRIVATE int insert_bucket(struct inode * dir, char * key, int inode_nr)
+{
+	int nr = nr_buckets(dir);
+	int blk = dir_hash(dir, key);
+	int i, j;
+
+	for (i = 0; i < nr; i++, blk = blk % nr + 1) {
+		struct buf * bp = read_dir_blk(dir, blk);
+		struct dir_entry * pde = (struct dir_entry *)bp->b_data;
+
+		for (j = 0; j < DIR_ENTS_PER_SECT; j++, pde++) {
+			if (pde->inode_nr == 0) { /* it's a free slot */
+				if (pde->name[0])
+					dir->i_nr_tombs--;
+				pde->inode_nr = inode_nr;
+				memcpy(pde->name, key, MAX_FILENAME_LEN);
+				bdwrite(bp);
+				brelse(bp);
+				return 0;
+			}
+		}
+		brelse(bp);
+	}
+
+	return -1;
+}
+
+/*****************************************************************************
+ *                                rehash
+ *****************************************************************************/
+/**
+ * Rebuild the buckets of a directory, dropping the removed entries. The
+ * head sector is left alone.
+ *
+ * @param dir       I-node of the directory.
+ * @param nr_sects  How many sectors the directory has afterwards, not less
+ *                  than it has now.
+ *
+ * @return Zero if successful, -1 if the device is full.
+ *****************************************************************************/
+PRIVATE int rehash(struct inode * dir, int nr_sects)
+{
+	struct dir_entry * ents = (struct dir_entry *)fsbuf;
+	int nr_ents = 0;
+	int i, j;
+
+	assert(nr_sects * SECTOR_SIZE <= FSBUF_SIZE / 2);
+	if (extend_file(dir, nr_sects) < nr_sects)
+		return -1;
+
+	/* save the live entries of the buckets */
+	for (i = 1; i <= nr_buckets(dir); i++) {
+		struct buf * bp = read_dir_blk(dir, i);
+		struct dir_entry * pde = (struct dir_entry *)bp->b_data;
+
+		for (j = 0; j < DIR_ENTS_PER_SECT; j++, pde++)
+			if (pde->inode_nr)
+				ents[nr_ents++] = *pde;
+		brelse(bp);
+	}
+
+	zero_dir_blks(dir, 1, nr_sects);
+	if (dir->i_size != nr_sects * SECTOR_SIZE) {
+		dir->i_size = nr_sects * SECTOR_SIZE;
+		sync_inode(dir);
+	}
+	dir->i_nr_tombs = 0;
+
+	for (i = 0; i < nr_ents; i++) {
+		int ret = insert_bucket(dir, ents[i].name, ents[i].inode_nr);
+		assert(ret == 0);
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ *                                index_dir
+ *****************************************************************************/
+/**
+ * Count the entries of a directory, if not yet since its i-node was read.
+ *
+ * @param dir  I-node of the directory.
+ *****************************************************************************/
+PRIVATE void index_dir(struct inode * dir)
+{
+	int i, j;
+
+	if (dir->i_nr_ents >= 0)
+		return;
+
+	dir->i_nr_ents = 0;
+	dir->i_nr_tombs = 0;
+	dir->i_head_free = 0;
+
+	for (i = 0; i <= nr_buckets(dir); i++) {
+		struct buf * bp = read_dir_blk(dir, i);
+		struct dir_entry * pde = (struct dir_entry *)bp->b_data;
+
+		for (j = 0; j < DIR_ENTS_PER_SECT; j++, pde++) {
+			if (pde->inode_nr)
+				dir->i_nr_ents++;
+			else if (i == 0)
+				dir->i_head_free++;
+			else if (pde->name[0])
+				dir->i_nr_tombs++;
+		}
+		brelse(bp);
+	}
+}
+
+/*****************************************************************************
+ *                                zero_dir_blks
+ *****************************************************************************/
+/**
+ * Clear some sectors of a directory.
+ *
+ * @param dir   I-node of the directory.
+ * @param from  Sector index of the first sector in the directory.
+ * @param to    Sector index after the last one.
+ *****************************************************************************/
+PRIVATE void zero_dir_blks(struct inode * dir, int from, int to)
+{
+	int i;
+
+	for (i = from; i < to; i++) {
+		int sect_nr = bmap(dir, i, 0);
+		assert(sect_nr);
+
+		struct buf * bp = getblk(dir->i_dev, sect_nr);
+		memset(bp->b_data, 0, SECTOR_SIZE);
+		bdwrite(bp);
+		brelse(bp);
+	}
+}
+
+/*****************************************************************************
+ *                                read_dir_blk
+ *****************************************************************************/
+/**
+ * Read a sector of a directory.
+ *
+ * @param dir  I-node of the directory.
+ * @param blk  Sector index in the directory.
+ *
+ * @return Ptr to the buffer, which must be released by brelse().
+ *****************************************************************************/
+PRIVATE struct buf * read_dir_blk(struct inode * dir, int blk)
+{
+	int sect_nr = bmap(dir, blk, 0);
+
+	assert(sect_nr);
+	return bread(dir->i_dev, sect_nr);
+}
+
+/*****************************************************************************
+ *                                nr_buckets
+ *****************************************************************************/
+/**
+ * @param dir  I-node of the directory.
+ *
+ * @return How many buckets the directory has.
+ *****************************************************************************/
+PRIVATE int nr_buckets(struct inode * dir)
+{
+	return dir->i_size / SECTOR_SIZE - 1;
+}
+
+/*****************************************************************************
+ *                                dir_hash
+ *****************************************************************************/
+/**
+ * @param dir  I-node of the directory.
+ * @param key  Filename padded by pad_name().
+ *
+ * @return Sector index of the bucket of the name, 1 ~ nr_buckets(dir).
+ *****************************************************************************/
+PRIVATE int dir_hash(struct inode * dir, const char * key)
+{
+	u32 h = 0;
+	int i;
+
+	for (i = 0; i < MAX_FILENAME_LEN && key[i]; i++)
+		h = h * 31 + (u8)key[i];
+
+	return h % nr_buckets(dir) + 1;
+}
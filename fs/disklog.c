@@ -28,13 +28,13 @@
 					       dev,			\
 					       (sect_nr) * SECTOR_SIZE,	\
 					       SECTOR_SIZE, /* read one sector */ \
-					       getpid(),		\
+					       TASK_FS,		\
 					       logdiskbuf);
 #define DISKLOG_WR_SECT(dev,sect_nr) rw_sector(DEV_WRITE, \
 					       dev,			\
 					       (sect_nr) * SECTOR_SIZE,	\
 					       SECTOR_SIZE, /* write one sector */ \
-					       getpid(),		\
+					       TASK_FS,		\
 					       logdiskbuf);
 
 
@@ -63,64 +63,123 @@
 /* } */
 
 /*****************************************************************************
- *                                disklog
+ *                                init_disklog
  *****************************************************************************/
 /**
- * <Ring 1> Write log string directly into disk.
- * 
- * @param p  Ptr to the MESSAGE.
+ * <Ring 1> Set sector-map so that other files cannot use the log sectors.
+ *
+ * It is invoked by FS at startup rather than by the first disklog(), because
+ * disklog() may run in any process while the sector-map sectors are held by
+ * the buffer cache of FS.
  *****************************************************************************/
-PUBLIC int disklog(char * logstr)
+PUBLIC void init_disklog()
 {
+#ifdef SET_LOG_SECT_SMAP_AT_STARTUP
 	int device = root_inode->i_dev;
 	struct super_block * sb = get_super_block(device);
 	int nr_log_blk0_nr = sb->nr_sects - NR_SECTS_FOR_LOG; /* 0x9D41-0x800=0x9541 */
 
-	static int pos = 0;
-	if (!pos) { /* first time invoking this routine */
+	int bits_per_sect = SECTOR_SIZE * 8; /* 4096 */
 
-#ifdef SET_LOG_SECT_SMAP_AT_STARTUP
-		/*
-		 * set sector-map so that other files cannot use the log sectors
-		 */
-
-		int bits_per_sect = SECTOR_SIZE * 8; /* 4096 */
+	int smap_blk0_nr = 1 + 1 + sb->nr_imap_sects; /* 3 */
+	int sect_nr  = smap_blk0_nr + nr_log_blk0_nr / bits_per_sect; /* 3+9=12 */
+	int byte_off = (nr_log_blk0_nr % bits_per_sect) / 8; /* 168 */
+	int bit_off  = (nr_log_blk0_nr % bits_per_sect) % 8; /* 1 */
+	int sect_cnt = NR_SECTS_FOR_LOG / bits_per_sect + 2; /* 1 */
+	int bits_left= NR_SECTS_FOR_LOG; /* 2048 */
 
-		int smap_blk0_nr = 1 + 1 + sb->nr_imap_sects; /* 3 */
-		int sect_nr  = smap_blk0_nr + nr_log_blk0_nr / bits_per_sect; /* 3+9=12 */
-		int byte_off = (nr_log_blk0_nr % bits_per_sect) / 8; /* 168 */
-		int bit_off  = (nr_log_blk0_nr % bits_per_sect) % 8; /* 1 */
-		int sect_cnt = NR_SECTS_FOR_LOG / bits_per_sect + 2; /* 1 */
-		int bits_left= NR_SECTS_FOR_LOG; /* 2048 */
-
-		int i;
-		for (i = 0; i < sect_cnt; i++) {
-			DISKLOG_RD_SECT(device, sect_nr + i); /* DISKLOG_RD_SECT(?, 12) */
-
-			for (; byte_off < SECTOR_SIZE && bits_left > 0; byte_off++) {
-				for (; bit_off < 8; bit_off++) { /* repeat till enough bits are set */
-					//assert(((logdiskbuf[byte_off] >> bit_off) & 1) == 0);
-					logdiskbuf[byte_off] |= (1 << bit_off);
-					if (--bits_left  == 0)
-						break;
-				}
-				bit_off = 0;
+	int i;
+	for (i = 0; i < sect_cnt; i++) {
+		struct buf * bp = bread(device, sect_nr + i);
+
+		for (; byte_off < SECTOR_SIZE && bits_left > 0; byte_off++) {
+			for (; bit_off < 8; bit_off++) { /* repeat till enough bits are set */
+				bp->b_data[byte_off] |= (1 << bit_off);
+				if (--bits_left  == 0)
+					break;
 			}
-			byte_off = 0;
 			bit_off = 0;
+		}
+		byte_off = 0;
+		bit_off = 0;
 
-			DISKLOG_WR_SECT(device, sect_nr + i);
+		bdwrite(bp);
+		brelse(bp);
 
-			if (bits_left == 0)
-				break;
-		}
-		assert(bits_left == 0);
+		if (bits_left == 0)
+			break;
+	}
+	assert(bits_left == 0);
 #endif /* SET_LOG_SECT_SMAP_AT_STARTUP */
+}
+
+/**
+ * The log is a sequence of records (struct log_rec) after a 0x40-byte text
+ * header. It is appended to logring[] and written to the disk by
+ * disklog_flush() in whole sectors. logring[0] is the first byte of log
+ * sector `log_sect' (relative to the first log sector), and logring[log_len]
+ * is where the next record goes. The log position is thus
+ * log_sect * SECTOR_SIZE + log_len.
+ */
+PRIVATE char	logring[NR_LOG_BUF_SECTS * SECTOR_SIZE];
+PRIVATE int	log_sect;
+PRIVATE int	log_len	= -1;	/* -1 before the first disklog() */
+PRIVATE int	log_dirty;	/* nonzero if logring has unflushed records */
+
+PRIVATE void	fill_log_header	(char * buf, int pos, struct time * t);
 
-		pos = 0x40;
+/*****************************************************************************
+ *                                disklog
+ *****************************************************************************/
+/**
+ * <Ring 1> Append a text line to the log, as a LOG_TEXT record.
+ * 
+ * @param logstr  The string.
+ *
+ * @return The log position after the record.
+ *****************************************************************************/
+PUBLIC int disklog(char * logstr)
+{
+	u32 rec[(sizeof(struct log_rec) + STR_DEFAULT_LEN) / 4];
+	struct log_rec * r = (struct log_rec *)rec;
+	int len = min(strlen(logstr), 255 * 4);
+	int nr_args = (len + 3) / 4;
+
+	if (nr_args)
+		rec[sizeof(*r) / 4 + nr_args - 1] = 0;	/* padding */
+	memcpy(r + 1, logstr, len);
+	r->event = LOG_TEXT;
+	r->nr_args = nr_args;
+	r->pid = TASK_FS;	/* only FS logs */
+	r->tick = get_ticks();
+
+	return disklog_write(rec, sizeof(*r) + nr_args * 4);
+}
 
+/*****************************************************************************
+ *                                disklog_write
+ *****************************************************************************/
+/**
+ * <Ring 1> Append a record to the log. It is written to the disk by
+ * disklog_flush() later, when enough records have piled up, when FS syncs,
+ * or periodically by the clock. A record is dropped as a whole if the log
+ * is full.
+ * 
+ * @param rec  The record, see struct log_rec.
+ * @param len  Its size in bytes.
+ *
+ * @return The log position after the record.
+ *****************************************************************************/
+PUBLIC int disklog_write(const void * rec, int len)
+{
+	if (log_len < 0) { /* first time invoking this routine */
+		/* the log sectors are reserved in sector-map by init_disklog() */
 #ifdef MEMSET_LOG_SECTS
 		/* write padding stuff to log sectors */
+		int device = root_inode->i_dev;
+		struct super_block * sb = get_super_block(device);
+		int nr_log_blk0_nr = sb->nr_sects - NR_SECTS_FOR_LOG;
+		int i;
 		int chunk = min(MAX_IO_BYTES, LOGDISKBUF_SIZE >> SECTOR_SIZE_SHIFT);
 		assert(chunk == 256);
 		int sects_left = NR_SECTS_FOR_LOG;
@@ -132,64 +191,128 @@ PUBLIC int disklog(char * logstr)
 				  device,
 				  i * SECTOR_SIZE,
 				  chunk * SECTOR_SIZE,
-				  getpid(),
+				  TASK_FS,
 				  logdiskbuf);
 			sects_left -= chunk;
 		}
 		if (sects_left != 0)
 			panic("sects_left should be 0, current: %d.", sects_left);
 #endif /* MEMSET_LOG_SECTS */
+
+		/* the first 0x40 bytes are the header, see fill_log_header() */
+		log_sect = 0;
+		log_len = 0x40;
+		memset(logring, ' ', log_len);
 	}
 
-	char * p = logstr;
-	int bytes_left = strlen(logstr);
+	/* the last log sector is not for records */
+	int room = (NR_SECTS_FOR_LOG - 1 - log_sect) * SECTOR_SIZE - log_len;
+	if (len > room)
+		return log_sect * SECTOR_SIZE + log_len;
 
-	int sect_nr = nr_log_blk0_nr + (pos >> SECTOR_SIZE_SHIFT);
+	const char * p = rec;
+	while (len) {
+		if (log_len == sizeof(logring))
+			disklog_flush();
 
-	while (bytes_left) {
-		DISKLOG_RD_SECT(device, sect_nr);
+		int bytes = min(len, sizeof(logring) - log_len);
+		memcpy(&logring[log_len], (void*)p, bytes);
+		log_len += bytes;
+		len -= bytes;
+		p += bytes;
+	}
+	log_dirty = 1;
 
-		int off = pos % SECTOR_SIZE;
-		int bytes = min(bytes_left, SECTOR_SIZE - off);
+	if (log_len >= LOG_FLUSH_SECTS * SECTOR_SIZE)
+		disklog_flush();
 
-		memcpy(&logdiskbuf[off], p, bytes);
-		off += bytes;
-		bytes_left -= bytes;
+	return log_sect * SECTOR_SIZE + log_len;
+}
 
-		DISKLOG_WR_SECT(device, sect_nr);
-		sect_nr++;
-		pos += bytes;
-		p += bytes;
-	}
+/*****************************************************************************
+ *                                disklog_flush
+ *****************************************************************************/
+/**
+ * <Ring 1> Write the records in logring[] to the disk, with one I/O for all the
+ * sectors, then update the header (log position and time) once.
+ *****************************************************************************/
+PUBLIC void disklog_flush()
+{
+	if (!log_dirty)
+		return;
+
+	int device = root_inode->i_dev;
+	struct super_block * sb = get_super_block(device);
+	int nr_log_blk0_nr = sb->nr_sects - NR_SECTS_FOR_LOG; /* 0x9D41-0x800=0x9541 */
+	int pos = log_sect * SECTOR_SIZE + log_len;
 
 	struct time t;
-	MESSAGE msg;
-	msg.type = GET_RTC_TIME;
-	msg.BUF= &t;
-	send_recv(BOTH, TASK_SYS, &msg);
+	get_time(&t);
+
+	/* the header is in logring[] if sector 0 is */
+	if (log_sect == 0)
+		fill_log_header(logring, pos, &t);
+
+	/* pad the last sector as MEMSET_LOG_SECTS does */
+	int nr_sects = (log_len + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	memset(&logring[log_len], ' ', nr_sects * SECTOR_SIZE - log_len);
+
+	rw_sector(DEV_WRITE,
+		  device,
+		  (nr_log_blk0_nr + log_sect) * SECTOR_SIZE,
+		  nr_sects * SECTOR_SIZE,
+		  TASK_FS,
+		  logring);
 
 	/* write `pos' and time into the log file header */
-	DISKLOG_RD_SECT(device, nr_log_blk0_nr);
-
-	sprintf((char*)logdiskbuf, "%8d\n", pos);
-	memset(logdiskbuf+9, ' ', 22);
-	logdiskbuf[31] = '\n';
-
-	sprintf((char*)logdiskbuf+32, "<%d-%02d-%02d %02d:%02d:%02d>\n",
-		t.year,
-		t.month,
-		t.day,
-		t.hour,
-		t.minute,
-		t.second);
-	memset(logdiskbuf+32+22, ' ', 9);
-	logdiskbuf[63] = '\n';
-
-	DISKLOG_WR_SECT(device, nr_log_blk0_nr);
+	if (log_sect == 0) {
+		memcpy(logdiskbuf, logring, 0x40);
+	}
+	else {
+		DISKLOG_RD_SECT(device, nr_log_blk0_nr);
+		fill_log_header(logdiskbuf, pos, &t);
+		DISKLOG_WR_SECT(device, nr_log_blk0_nr);
+	}
 	memset(logdiskbuf+64, logdiskbuf[32+19], 512-64);
 	DISKLOG_WR_SECT(device, nr_log_blk0_nr + NR_SECTS_FOR_LOG - 1);
 
-	return pos;
+	/* keep the last partial sector, the next records go after it */
+	int full = log_len / SECTOR_SIZE;
+	if (full && full * SECTOR_SIZE < log_len)
+		memcpy(logring, &logring[full * SECTOR_SIZE], log_len % SECTOR_SIZE);
+	log_sect += full;
+	log_len %= SECTOR_SIZE;
+
+	log_dirty = 0;
+}
+
+/*****************************************************************************
+ *                                fill_log_header
+ *****************************************************************************/
+/**
+ * <Ring 1> Fill the 0x40-byte log header: the log position, the format
+ * version and the time.
+ *
+ * @param buf  Where the header goes.
+ * @param pos  Log position.
+ * @param t    Time of the flush.
+ *****************************************************************************/
+PRIVATE void fill_log_header(char * buf, int pos, struct time * t)
+{
+	sprintf(buf, "%8d\nbinlog %d", pos, LOG_VERSION);
+	int n = strlen(buf);
+	memset(buf+n, ' ', 31-n);
+	buf[31] = '\n';
+
+	sprintf(buf+32, "<%d-%02d-%02d %02d:%02d:%02d>\n",
+		t->year,
+		t->month,
+		t->day,
+		t->hour,
+		t->minute,
+		t->second);
+	memset(buf+32+22, ' ', 9);
+	buf[63] = '\n';
 }
 
 /* /\***************************************************************************** */
@@ -291,7 +414,7 @@ PUBLIC int dump_fd_graph(int str)
 		"HANGING", "FREE_SLOT", "UNKNOWN", "UNKNOWN"
 	};
 	// 表头
-	len += sprintf(buf + len, "PID-Name-State-Parent-Prio-Ticks\n");
+	len += sprintf(buf + len, "PID-Name-State-Parent-Prio-Ticks-Run\n");
 	for (i = 0; i < NR_TASKS + NR_PROCS; i++, p_proc++) {
 		if (p_proc->p_flags == FREE_SLOT) continue; // 跳过空槽
 		int flag = p_proc->p_flags;
@@ -303,8 +426,9 @@ PUBLIC int dump_fd_graph(int str)
 		else if (flag == 4) state = "HANGING";
 		else if (flag == 5) state = "FREE_SLOT";
 		else state = "UNKNOWN";
-		len += sprintf(buf + len, "%d    %s    %s   %d    %d    %d\n",
-			i, p_proc->name, state, p_proc->p_parent, p_proc->priority, p_proc->ticks);
+		len += sprintf(buf + len, "%d    %s    %s   %d    %d    %d    %d\n",
+			i, p_proc->name, state, p_proc->p_parent, p_proc->priority, p_proc->ticks,
+			p_proc->run_ticks);
 		if (len > STR_DEFAULT_LEN - 64) break; // 防止缓冲区溢出
 	}
 	buf[STR_DEFAULT_LEN-1] = '\0'; // 保证字符串结尾
@@ -364,7 +488,7 @@ PUBLIC int dump_fd_graph(int str)
 		}
 
 		// 2. 标记进程表项为空闲
-		p_proc->p_flags = FREE_SLOT;
+		free_proc(p_proc);
 		// 3. 其他资源可根据需要补充释放
 		    memset(fs_msg.pBUF, 0, sizeof(fs_msg.pBUF));
 	    sprintf(fs_msg.pBUF, "Process killed successfully!\n");
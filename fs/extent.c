@@ -0,0 +1,659 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   fs/extent.c
+ * @brief  I-node and sector allocation.
+ * The file contains:
+ *   - bmap()
+ *   - extend_file()
+ *   - free_extents()
+ *   - init_bitmaps()
+ *   - alloc_imap_bit()
+ *   - free_imap_bit()
+ *   - set_smap_bits()
+ *
+ * Bit N of the sector-map stands for sector (sb->n_1st_sect + N). A file
+ * takes sectors as it grows. The new sectors are put right after the last
+ * extent if they are free, so that a file written sequentially stays in
+ * one extent. kernel.bin, which the boot loader reads from extent 0 only,
+ * is moved to a larger free run when it can't grow in place.
+ *
+ * The sectors of both maps are held in the buffer cache as long as the
+ * device is in use. They are searched 32 bits at a time, starting from a
+ * hint before which no bit is free, so the cost of an allocation does not
+ * grow with how full the device is.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE void get_extent(struct inode * pin, int idx, struct extent * pe);
+PRIVATE void put_extent(struct inode * pin, int idx, struct extent * pe);
+PRIVATE int add_extent(struct inode * pin, int start_sect, int nr_sects);
+PRIVATE int alloc_sects(int dev, int goal, int nr_sects, int * nr_got);
+PRIVATE int boot_file(struct inode * pin);
+PRIVATE int move_file(struct inode * pin, int nr_sects);
+PRIVATE int bsf(u32 x);
+PRIVATE u32 * bitmap_word(struct bitmap * bm, int bit);
+PRIVATE int find_zero(struct bitmap * bm, int from);
+PRIVATE int find_one(struct bitmap * bm, int from, int limit);
+PRIVATE void set_bits(struct bitmap * bm, int bit, int nr_bits, int val);
+
+/*****************************************************************************
+ *                                bmap
+ *****************************************************************************/
+/**
+ * Map a sector of a file to the sector in the device.
+ *
+ * @param pin  I-node of the file.
+ * @param blk  Sector index in the file.
+ * @param run  If not zero, it is set to how many sectors starting from
+ *             \c blk are contiguous in the device.
+ *
+ * @return The sector nr.\ in the device, zero if \c blk is not allocated.
+ *****************************************************************************/
+PUBLIC int bmap(struct inode * pin, int blk, int * run)
+{
+	struct extent e;
+	int i;
+
+	for (i = 0; i < pin->i_nr_exts; i++) {
+		get_extent(pin, i, &e);
+		if (blk < e.e_nr) {
+			if (run)
+				*run = e.e_nr - blk;
+			return e.e_start + blk;
+		}
+		blk -= e.e_nr;
+	}
+
+	if (run)
+		*run = 0;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                extend_file
+ *****************************************************************************/
+/**
+ * Make sure a file has at least the given nr of sectors.
+ *
+ * @param pin       I-node of the file.
+ * @param nr_sects  How many sectors the file needs.
+ *
+ * @return How many sectors the file has. It is less than \c nr_sects if
+ *         the device is full or the file has used up its extents, or for
+ *         kernel.bin, if there is no free run large enough for it.
+ *****************************************************************************/
+PUBLIC int extend_file(struct inode * pin, int nr_sects)
+{
+	struct extent e;
+	int total = 0;
+	int changed = 0;
+	int i;
+
+	for (i = 0; i < pin->i_nr_exts; i++) {
+		get_extent(pin, i, &e);
+		total += e.e_nr;
+	}
+
+	while (total < nr_sects) {
+		int goal = 0;
+		if (pin->i_nr_exts) {
+			get_extent(pin, pin->i_nr_exts - 1, &e);
+			goal = e.e_start + e.e_nr;
+		}
+
+		int got;
+		int start = alloc_sects(pin->i_dev, goal, nr_sects - total, &got);
+		if (start == 0) {
+			printl("{FS} no free sector for inode %d\n", pin->i_num);
+			break;
+		}
+
+		if (start == goal) {
+			e.e_nr += got;
+			put_extent(pin, pin->i_nr_exts - 1, &e);
+		}
+		else if (pin->i_nr_exts == 1 && boot_file(pin)) {
+			set_smap_bits(pin->i_dev, start, got, 0);
+			got = move_file(pin, nr_sects);
+			if (got == 0) {
+				printl("{FS} no room for inode %d in one extent\n",
+				       pin->i_num);
+				break;
+			}
+			total = got;
+			changed = 1;
+			break;
+		}
+		else if (!add_extent(pin, start, got)) {
+			set_smap_bits(pin->i_dev, start, got, 0);
+			printl("{FS} too many extents for inode %d\n", pin->i_num);
+			break;
+		}
+
+		total += got;
+		changed = 1;
+	}
+
+	if (changed)
+		sync_inode(pin);
+
+	return total;
+}
+
+/*****************************************************************************
+ *                                boot_file
+ *****************************************************************************/
+/**
+ * Tell whether a file is /kernel.bin, which the boot loader reads as one
+ * run of sectors from extent 0.
+ *
+ * @param pin  I-node of the file.
+ *
+ * @return Nonzero if it is.
+ *****************************************************************************/
+PRIVATE int boot_file(struct inode * pin)
+{
+	return (pin->i_mode & I_TYPE_MASK) == I_REGULAR &&
+	       pin->i_dev == root_inode->i_dev &&
+	       dir_lookup(root_inode, "kernel.bin") == pin->i_num;
+}
+
+/*****************************************************************************
+ *                                move_file
+ *****************************************************************************/
+/**
+ * Move a file of one extent to a larger free run, so that it grows and
+ * still has one extent. The old sectors are given back. The run is twice
+ * the old size if there is such a run, lest the file is moved again at
+ * every write as it grows.
+ *
+ * @param pin       I-node of the file, which has exactly one extent.
+ * @param nr_sects  How many sectors the file needs.
+ *
+ * @return How many sectors the file has now, zero if there is no free run
+ *         large enough and the file is left as it is.
+ *****************************************************************************/
+PRIVATE int move_file(struct inode * pin, int nr_sects)
+{
+	struct extent e;
+	int got;
+	int i;
+
+	assert(pin->i_nr_exts == 1);
+	get_extent(pin, 0, &e);
+
+	int want = max(nr_sects, e.e_nr * 2);
+	int start = alloc_sects(pin->i_dev, 0, want, &got);
+	if (start && got < want) {
+		set_smap_bits(pin->i_dev, start, got, 0);
+		want = nr_sects;
+		start = alloc_sects(pin->i_dev, 0, want, &got);
+		if (start && got < want) {
+			set_smap_bits(pin->i_dev, start, got, 0);
+			start = 0;
+		}
+	}
+	if (start == 0)
+		return 0;
+
+	/* only the sectors holding data are copied */
+	int used = min(e.e_nr, (pin->i_size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+	bprefetch(pin->i_dev, e.e_start, used);
+	for (i = 0; i < used; i++) {
+		struct buf * from = bread(pin->i_dev, e.e_start + i);
+		struct buf * to = getblk(pin->i_dev, start + i);
+		memcpy(to->b_data, from->b_data, SECTOR_SIZE);
+		bdwrite(to);
+		brelse(to);
+		brelse(from);
+	}
+
+	set_smap_bits(pin->i_dev, e.e_start, e.e_nr, 0);
+	binval(pin->i_dev, e.e_start, e.e_nr);
+
+	e.e_start = start;
+	e.e_nr = want;
+	put_extent(pin, 0, &e);
+
+	return want;
+}
+
+/*****************************************************************************
+ *                                free_extents
+ *****************************************************************************/
+/**
+ * Give all the sectors of a file back to the sector-map. The cached copies
+ * of the sectors are dropped, lest they are written over the next owner.
+ *
+ * @param pin  I-node of the file.
+ *****************************************************************************/
+PUBLIC void free_extents(struct inode * pin)
+{
+	struct extent e;
+	int i;
+
+	for (i = 0; i < pin->i_nr_exts; i++) {
+		get_extent(pin, i, &e);
+		set_smap_bits(pin->i_dev, e.e_start, e.e_nr, 0);
+		binval(pin->i_dev, e.e_start, e.e_nr);
+	}
+
+	if (pin->i_ext_sect) {
+		set_smap_bits(pin->i_dev, pin->i_ext_sect, 1, 0);
+		binval(pin->i_dev, pin->i_ext_sect, 1);
+	}
+
+	pin->i_start_sect = 0;
+	pin->i_nr_sects = 0;
+	memset(pin->i_ext, 0, sizeof(pin->i_ext));
+	pin->i_ext_sect = 0;
+	pin->i_nr_exts = 0;
+}
+
+/*****************************************************************************
+ *                                init_bitmaps
+ *****************************************************************************/
+/**
+ * Read the inode-map and the sector-map of a device into the buffer cache,
+ * where they stay until the system halts.
+ *
+ * @param dev  The device, whose super block has been read.
+ *****************************************************************************/
+PUBLIC void init_bitmaps(int dev)
+{
+	struct super_block * sb = get_super_block(dev);
+	int i;
+
+	assert(sb->nr_imap_sects <= MAX_BITMAP_SECTS);
+	assert(sb->nr_smap_sects <= MAX_BITMAP_SECTS);
+
+	sb->sb_imap.nr_bits = sb->nr_inodes;
+	sb->sb_imap.hint = 0;
+	for (i = 0; i < sb->nr_imap_sects; i++)
+		sb->sb_imap.bufs[i] = bread(dev, 1 + 1 + i);
+
+	sb->sb_smap.nr_bits = sb->nr_sects - sb->n_1st_sect;
+	sb->sb_smap.hint = 0;
+	for (i = 0; i < sb->nr_smap_sects; i++)
+		sb->sb_smap.bufs[i] = bread(dev, 1 + 1 + sb->nr_imap_sects + i);
+
+	assert(sb->sb_imap.nr_bits <= sb->nr_imap_sects * SECTOR_SIZE * 8);
+	assert(sb->sb_smap.nr_bits <= sb->nr_smap_sects * SECTOR_SIZE * 8);
+}
+
+/*****************************************************************************
+ *                                alloc_imap_bit
+ *****************************************************************************/
+/**
+ * Allocate a bit in inode-map.
+ * 
+ * @param dev  In which device the inode-map is located.
+ * 
+ * @return  I-node nr.
+ *****************************************************************************/
+PUBLIC int alloc_imap_bit(int dev)
+{
+	struct bitmap * bm = &get_super_block(dev)->sb_imap;
+	int inode_nr = find_zero(bm, bm->hint);
+
+	if (inode_nr < 0)
+		panic("inode-map is probably full.\n");
+
+	set_bits(bm, inode_nr, 1, 1);
+	bm->hint = inode_nr + 1;
+
+	return inode_nr;
+}
+
+/*****************************************************************************
+ *                                free_imap_bit
+ *****************************************************************************/
+/**
+ * Free a bit in inode-map.
+ * 
+ * @param dev       In which device the inode-map is located.
+ * @param inode_nr  I-node nr.
+ *****************************************************************************/
+PUBLIC void free_imap_bit(int dev, int inode_nr)
+{
+	struct bitmap * bm = &get_super_block(dev)->sb_imap;
+
+	set_bits(bm, inode_nr, 1, 0);
+	if (inode_nr < bm->hint)
+		bm->hint = inode_nr;
+}
+
+/*****************************************************************************
+ *                                set_smap_bits
+ *****************************************************************************/
+/**
+ * Set or clear the sector-map bits of some sectors.
+ *
+ * @param dev        In which device the sector-map is located.
+ * @param start_sect The 1st sector.
+ * @param nr_sects   How many sectors.
+ * @param val        1 to allocate the sectors, 0 to free them.
+ *****************************************************************************/
+PUBLIC void set_smap_bits(int dev, int start_sect, int nr_sects, int val)
+{
+	struct super_block * sb = get_super_block(dev);
+	struct bitmap * bm = &sb->sb_smap;
+	int bit = start_sect - sb->n_1st_sect;
+
+	assert(bit >= 0 && bit + nr_sects <= bm->nr_bits);
+
+	set_bits(bm, bit, nr_sects, val);
+	if (!val && bit < bm->hint)
+		bm->hint = bit;
+}
+
+/*****************************************************************************
+ *                                get_extent
+ *****************************************************************************/
+/**
+ * Get an extent of a file.
+ *
+ * @param pin  I-node of the file.
+ * @param idx  Index of the extent, less than pin->i_nr_exts.
+ * @param pe   Where to put the extent.
+ *****************************************************************************/
+PRIVATE void get_extent(struct inode * pin, int idx, struct extent * pe)
+{
+	assert(idx < pin->i_nr_exts);
+
+	if (idx == 0) {
+		pe->e_start = pin->i_start_sect;
+		pe->e_nr = pin->i_nr_sects;
+	}
+	else if (idx <= NR_INODE_EXTS) {
+		*pe = pin->i_ext[idx - 1];
+	}
+	else {
+		assert(pin->i_ext_sect);
+		struct buf * bp = bread(pin->i_dev, pin->i_ext_sect);
+		*pe = ((struct extent *)bp->b_data)[idx - 1 - NR_INODE_EXTS];
+		brelse(bp);
+	}
+}
+
+/*****************************************************************************
+ *                                put_extent
+ *****************************************************************************/
+/**
+ * Set an extent of a file. The i-node itself is not written back.
+ *
+ * @param pin  I-node of the file.
+ * @param idx  Index of the extent, less than pin->i_nr_exts.
+ * @param pe   The extent.
+ *****************************************************************************/
+PRIVATE void put_extent(struct inode * pin, int idx, struct extent * pe)
+{
+	assert(idx < pin->i_nr_exts);
+
+	if (idx == 0) {
+		pin->i_start_sect = pe->e_start;
+		pin->i_nr_sects = pe->e_nr;
+	}
+	else if (idx <= NR_INODE_EXTS) {
+		pin->i_ext[idx - 1] = *pe;
+	}
+	else {
+		assert(pin->i_ext_sect);
+		struct buf * bp = bread(pin->i_dev, pin->i_ext_sect);
+		((struct extent *)bp->b_data)[idx - 1 - NR_INODE_EXTS] = *pe;
+		bdwrite(bp);
+		brelse(bp);
+	}
+}
+
+/*****************************************************************************
+ *                                add_extent
+ *****************************************************************************/
+/**
+ * Append an extent to a file. The overflow extent sector is allocated when
+ * the in-inode extents are used up.
+ *
+ * @param pin        I-node of the file.
+ * @param start_sect The 1st sector of the extent.
+ * @param nr_sects   How many sectors the extent has.
+ *
+ * @return Nonzero if successful.
+ *****************************************************************************/
+PRIVATE int add_extent(struct inode * pin, int start_sect, int nr_sects)
+{
+	if (pin->i_nr_exts == MAX_FILE_EXTS)
+		return 0;
+
+	if (pin->i_nr_exts == 1 + NR_INODE_EXTS) {
+		int got;
+		int sect_nr = alloc_sects(pin->i_dev, 0, 1, &got);
+		if (sect_nr == 0)
+			return 0;
+
+		struct buf * bp = getblk(pin->i_dev, sect_nr);
+		memset(bp->b_data, 0, SECTOR_SIZE);
+		bdwrite(bp);
+		brelse(bp);
+		pin->i_ext_sect = sect_nr;
+	}
+
+	struct extent e;
+	e.e_start = start_sect;
+	e.e_nr = nr_sects;
+	pin->i_nr_exts++;
+	put_extent(pin, pin->i_nr_exts - 1, &e);
+
+	return 1;
+}
+
+/*****************************************************************************
+ *                                alloc_sects
+ *****************************************************************************/
+/**
+ * Allocate a run of free sectors. The sectors starting from \c goal are
+ * taken if they are free. Otherwise the first run which is large enough is
+ * taken, or the first free run at all if there is no such a run. Either
+ * way the sector-map is scanned only once.
+ *
+ * @param dev       In which device the sector-map is located.
+ * @param goal      The preferred 1st sector, zero if none.
+ * @param nr_sects  How many sectors are wanted.
+ * @param nr_got    How many sectors are allocated.
+ *
+ * @return The 1st sector allocated, zero if the device is full.
+ *****************************************************************************/
+PRIVATE int alloc_sects(int dev, int goal, int nr_sects, int * nr_got)
+{
+	struct super_block * sb = get_super_block(dev);
+	struct bitmap * bm = &sb->sb_smap;
+	int start = -1;
+	int len = 0;
+
+	if (goal) {
+		int bit = goal - sb->n_1st_sect;
+		if (bit < bm->nr_bits) {
+			start = bit;
+			len = find_one(bm, bit, min(bit + nr_sects, bm->nr_bits))
+				- bit;
+		}
+	}
+
+	if (len == 0) {
+		int first = -1;		/* the first free run */
+		int first_len = 0;
+		int bit = find_zero(bm, bm->hint);
+
+		bm->hint = bit < 0 ? bm->nr_bits : bit;
+
+		while (bit >= 0) {
+			int end = find_one(bm, bit,
+					   min(bit + nr_sects, bm->nr_bits));
+			if (end - bit == nr_sects) {
+				start = bit;
+				len = nr_sects;
+				break;
+			}
+			if (first < 0) {
+				first = bit;
+				first_len = end - bit;
+			}
+			bit = find_zero(bm, end);
+		}
+
+		if (len == 0) {
+			if (first < 0)
+				return 0;
+			start = first;
+			len = first_len;
+		}
+	}
+
+	set_bits(bm, start, len, 1);
+	if (start == bm->hint)
+		bm->hint = start + len;
+
+	*nr_got = len;
+	return sb->n_1st_sect + start;
+}
+
+/*****************************************************************************
+ *                                bsf
+ *****************************************************************************/
+/**
+ * Find the lowest set bit.
+ *
+ * @param x  A nonzero word.
+ *
+ * @return Index of the lowest `1' bit of x.
+ *****************************************************************************/
+PRIVATE int bsf(u32 x)
+{
+	int i;
+	__asm__ ("bsfl %1, %0" : "=r"(i) : "rm"(x));
+	return i;
+}
+
+/*****************************************************************************
+ *                                bitmap_word
+ *****************************************************************************/
+/**
+ * Locate the 32-bit word holding a bit. Bit N of a word is bit (N % 8) of
+ * byte (N / 8) on x86, so a word covers the bits in the same order as the
+ * bytes do.
+ *
+ * @param bm   The bitmap.
+ * @param bit  Bit index.
+ *
+ * @return Ptr to the word.
+ *****************************************************************************/
+PRIVATE u32 * bitmap_word(struct bitmap * bm, int bit)
+{
+	int bits_per_sect = SECTOR_SIZE * 8;
+	u32 * words = (u32 *)bm->bufs[bit / bits_per_sect]->b_data;
+
+	return &words[(bit % bits_per_sect) / 32];
+}
+
+/*****************************************************************************
+ *                                find_zero
+ *****************************************************************************/
+/**
+ * Find the first free bit.
+ *
+ * @param bm    The bitmap.
+ * @param from  Where to start.
+ *
+ * @return Index of the first `0' bit not before \c from, -1 if none.
+ *****************************************************************************/
+PRIVATE int find_zero(struct bitmap * bm, int from)
+{
+	int bit;
+
+	for (bit = from & ~31; bit < bm->nr_bits; bit += 32) {
+		u32 w = *bitmap_word(bm, bit);
+		if (bit < from)
+			w |= (1u << (from - bit)) - 1;
+		if (w != 0xFFFFFFFF) {
+			bit += bsf(~w);
+			return bit < bm->nr_bits ? bit : -1;
+		}
+	}
+
+	return -1;
+}
+
+/*****************************************************************************
+ *                                find_one
+ *****************************************************************************/
+/**
+ * Find the first used bit within a range.
+ *
+ * @param bm     The bitmap.
+ * @param from   Where to start.
+ * @param limit  Where to stop, no more than bm->nr_bits.
+ *
+ * @return Index of the first `1' bit in [from, limit), \c limit if none.
+ *****************************************************************************/
+PRIVATE int find_one(struct bitmap * bm, int from, int limit)
+{
+	int bit;
+
+	for (bit = from & ~31; bit < limit; bit += 32) {
+		u32 w = *bitmap_word(bm, bit);
+		if (bit < from)
+			w &= ~((1u << (from - bit)) - 1);
+		if (w)
+			return min(bit + bsf(w), limit);
+	}
+
+	return limit;
+}
+
+/*****************************************************************************
+ *                                set_bits
+ *****************************************************************************/
+/**
+ * Set or clear a run of bits, a word at a time. The bits must all be in
+ * the other state.
+ *
+ * @param bm       The bitmap.
+ * @param bit      The 1st bit.
+ * @param nr_bits  How many bits.
+ * @param val      1 to set the bits, 0 to clear them.
+ *****************************************************************************/
+PRIVATE void set_bits(struct bitmap * bm, int bit, int nr_bits, int val)
+{
+	int bits_per_sect = SECTOR_SIZE * 8;
+
+	while (nr_bits > 0) {
+		int shift = bit % 32;
+		int n = min(nr_bits, 32 - shift);
+		u32 mask = (n == 32 ? 0xFFFFFFFF : (1u << n) - 1) << shift;
+		u32 * w = bitmap_word(bm, bit);
+
+		if (val) {
+			assert((*w & mask) == 0);
+			*w |= mask;
+		}
+		else {
+			assert((*w & mask) == mask);
+			*w &= ~mask;
+		}
+		bdwrite(bm->bufs[bit / bits_per_sect]);
+
+		bit += n;
+		nr_bits -= n;
+	}
+}
@@ -0,0 +1,148 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   fs/io_ring.c
+ * @brief  Batched requests.
+ * The file contains:
+ *   - do_io_enter()
+ *
+ * A process queues FS requests in a struct io_ring of its own and sends
+ * one IO_ENTER for all of them. Each request is carried out by the same
+ * do_xxx() as its own message would be, so the only saving is in IPC:
+ * one rendezvous and one schedule per batch instead of per request.
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+PRIVATE int do_sqe(struct io_sqe * sqe, int * last_fd);
+PRIVATE int valid_fd(int fd);
+
+/*****************************************************************************
+ *                                do_io_enter
+ *****************************************************************************/
+/**
+ * Handle the message IO_ENTER: carry out the requests in the submission
+ * queue of the caller's ring, in order, and post their results.
+ * 
+ * @return How many requests have been taken.
+ *****************************************************************************/
+PUBLIC int do_io_enter()
+{
+	void * ring_addr = fs_msg.BUF;
+	int src = fs_msg.source;
+	struct io_ring ring;
+	int n = 0;
+
+	phys_copy((void*)va2la(TASK_FS, &ring),
+		  (void*)va2la(src, ring_addr),
+		  sizeof(struct io_ring));
+
+	/* the indices come from the caller, trust none of them */
+	if (ring.sq_tail - ring.sq_head > IO_RING_ENTS)
+		ring.sq_tail = ring.sq_head + IO_RING_ENTS;
+
+	while (ring.sq_head != ring.sq_tail &&
+	       ring.cq_tail - ring.cq_head < IO_RING_ENTS) {
+		struct io_sqe * sqe = &ring.sq[ring.sq_head++ & (IO_RING_ENTS - 1)];
+		struct io_cqe * cqe = &ring.cq[ring.cq_tail++ & (IO_RING_ENTS - 1)];
+
+		cqe->user_data = sqe->user_data;
+		cqe->res = do_sqe(sqe, &ring.last_fd);
+		n++;
+	}
+
+	phys_copy((void*)va2la(src, ring_addr),
+		  (void*)va2la(TASK_FS, &ring),
+		  sizeof(struct io_ring));
+
+	/* do_rdwt() has changed it, but the caller is waiting for a reply */
+	fs_msg.type = IO_ENTER;
+
+	return n;
+}
+
+/*****************************************************************************
+ *                                do_sqe
+ *****************************************************************************/
+/**
+ * Carry out a request by putting its parameters where its own message
+ * would have them.
+ * 
+ * @param sqe      The request.
+ * @param last_fd  The fd IO_FD_PREV stands for, updated by OPEN.
+ * 
+ * @return What the syscall would have returned, -1 if the request is not
+ *         valid here.
+ *****************************************************************************/
+PRIVATE int do_sqe(struct io_sqe * sqe, int * last_fd)
+{
+	int fd = sqe->fd == IO_FD_PREV ? *last_fd : sqe->fd;
+
+	switch (sqe->opcode) {
+	case OPEN:
+		fs_msg.FLAGS	= sqe->flags;
+		fs_msg.PATHNAME	= sqe->buf;
+		fs_msg.NAME_LEN	= sqe->len;
+		*last_fd = do_open();
+		return *last_fd;
+	case STAT:
+		fs_msg.PATHNAME	= sqe->buf;
+		fs_msg.NAME_LEN	= sqe->len;
+		fs_msg.BUF	= sqe->addr;
+		return do_stat();
+	case UNLINK:
+		fs_msg.PATHNAME	= sqe->buf;
+		fs_msg.NAME_LEN	= sqe->len;
+		return do_unlink();
+	case CLOSE:
+		if (!valid_fd(fd))
+			return -1;
+		fs_msg.FD	= fd;
+		return do_close();
+	case LSEEK:
+		if (!valid_fd(fd))
+			return -1;
+		fs_msg.FD	= fd;
+		fs_msg.OFFSET	= sqe->off;
+		fs_msg.WHENCE	= sqe->flags;
+		return do_lseek();
+	case READ:
+	case WRITE:
+		if (!valid_fd(fd))
+			return -1;
+		/* a TTY may keep the caller waiting, which a batch cannot */
+		if ((pcaller->filp[fd]->fd_inode->i_mode & I_TYPE_MASK) ==
+		    I_CHAR_SPECIAL)
+			return -1;
+		fs_msg.type	= sqe->opcode;
+		fs_msg.FD	= fd;
+		fs_msg.BUF	= sqe->buf;
+		fs_msg.CNT	= sqe->len;
+		return do_rdwt();
+	default:
+		return -1;
+	}
+}
+
+/*****************************************************************************
+ *                                valid_fd
+ *****************************************************************************/
+/**
+ * @param fd  File descriptor of the caller.
+ * 
+ * @return Nonzero if \c fd is open.
+ *****************************************************************************/
+PRIVATE int valid_fd(int fd)
+{
+	return fd >= 0 && fd < NR_FILES && pcaller->filp[fd] != 0;
+}
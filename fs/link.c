@@ -21,6 +21,8 @@
 #include "proto.h"
 
 
+PRIVATE int remove_file(int mode);
+
 /*****************************************************************************
  *                                do_unlink
  *****************************************************************************/
@@ -33,6 +35,34 @@
  * @return On success, zero is returned.  On error, -1 is returned.
  *****************************************************************************/
 PUBLIC int do_unlink()
+{
+	return remove_file(I_REGULAR);
+}
+
+/*****************************************************************************
+ *                                do_rmdir
+ *****************************************************************************/
+/**
+ * Remove an empty directory.
+ * 
+ * @return On success, zero is returned.  On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int do_rmdir()
+{
+	return remove_file(I_DIRECTORY);
+}
+
+/*****************************************************************************
+ *                                remove_file
+ *****************************************************************************/
+/**
+ * Remove a regular file or an empty directory, whose pathname is in fs_msg.
+ *
+ * @param mode  I_REGULAR or I_DIRECTORY, what the file must be.
+ * 
+ * @return On success, zero is returned.  On error, -1 is returned.
+ *****************************************************************************/
+PRIVATE int remove_file(int mode)
 {
 	char pathname[MAX_PATH];
 
@@ -45,150 +75,76 @@ PUBLIC int do_unlink()
 		  name_len);
 	pathname[name_len] = 0;
 
-	if (strcmp(pathname , "/") == 0) {
-		printl("{FS} FS:do_unlink():: cannot unlink the root\n");
+	char filename[MAX_PATH];
+	struct inode * dir_inode;
+	if (strip_path(filename, pathname, &dir_inode) != 0)
 		return -1;
-	}
 
-	int inode_nr = search_file(pathname);
-	if (inode_nr == INVALID_INODE) {	/* file not found */
-		printl("{FS} FS::do_unlink():: search_file() returns "
-			"invalid inode: %s\n", pathname);
+	if (filename[0] == 0 ||
+	    strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0) {
+		printl("{FS} FS:remove_file():: cannot remove %s\n", pathname);
+		put_inode(dir_inode);
 		return -1;
 	}
 
-	char filename[MAX_PATH];
-	struct inode * dir_inode;
-	if (strip_path(filename, pathname, &dir_inode) != 0)
+	int inode_nr = dir_lookup(dir_inode, filename);
+	if (inode_nr == INVALID_INODE) {	/* file not found */
+		printl("{FS} FS::remove_file():: file not found: %s\n",
+		       pathname);
+		put_inode(dir_inode);
 		return -1;
+	}
 
 	struct inode * pin = get_inode(dir_inode->i_dev, inode_nr);
+	int ret = -1;
 
-	if (pin->i_mode != I_REGULAR) { /* can only remove regular files */
+	if (pin->i_mode != mode) { /* regular files or directories only */
 		printl("{FS} cannot remove file %s, because "
-		       "it is not a regular file.\n",
-		       pathname);
-		return -1;
+		       "it is not a %s.\n", pathname,
+		       mode == I_DIRECTORY ? "directory" : "regular file");
 	}
-
-	if (pin->i_cnt > 1) {	/* the file was opened */
+	else if (pin->i_cnt > 1) { /* the file was opened, or is a cwd */
 		printl("{FS} cannot remove file %s, because pin->i_cnt is %d.\n",
 		       pathname, pin->i_cnt);
-		return -1;
-	}
-
-	struct super_block * sb = get_super_block(pin->i_dev);
-
-	/*************************/
-	/* free the bit in i-map */
-	/*************************/
-	int byte_idx = inode_nr / 8;
-	int bit_idx = inode_nr % 8;
-	assert(byte_idx < SECTOR_SIZE);	/* we have only one i-map sector */
-	/* read sector 2 (skip bootsect and superblk): */
-	RD_SECT(pin->i_dev, 2);
-	assert(fsbuf[byte_idx % SECTOR_SIZE] & (1 << bit_idx));
-	fsbuf[byte_idx % SECTOR_SIZE] &= ~(1 << bit_idx);
-	WR_SECT(pin->i_dev, 2);
-
-	/**************************/
-	/* free the bits in s-map */
-	/**************************/
-	/*
-	 *           bit_idx: bit idx in the entire i-map
-	 *     ... ____|____
-	 *                  \        .-- byte_cnt: how many bytes between
-	 *                   \      |              the first and last byte
-	 *        +-+-+-+-+-+-+-+-+ V +-+-+-+-+-+-+-+-+
-	 *    ... | | | | | |*|*|*|...|*|*|*|*| | | | |
-	 *        +-+-+-+-+-+-+-+-+   +-+-+-+-+-+-+-+-+
-	 *         0 1 2 3 4 5 6 7     0 1 2 3 4 5 6 7
-	 *  ...__/
-	 *      byte_idx: byte idx in the entire i-map
-	 */
-	int bits_left = pin->i_nr_sects;
-	int start_bit = pin->i_start_sect - sb->n_1st_sect;
-	int smap_blk0_nr = 2 + sb->nr_imap_sects;
-	int total_bits = sb->nr_smap_sects * SECTOR_SIZE * 8;
-	int cur_bit = start_bit;
-	while (bits_left > 0 && cur_bit < total_bits) {
-		int sect_idx = cur_bit / (SECTOR_SIZE * 8);
-		RD_SECT(pin->i_dev, smap_blk0_nr + sect_idx);
-		int sect_offset = sect_idx * SECTOR_SIZE * 8;
-		for (int i = 0; i < SECTOR_SIZE && bits_left > 0; i++) {
-			for (int k = 0; k < 8 && bits_left > 0; k++) {
-				int bit_global = sect_offset + i * 8 + k;
-				if (bit_global < start_bit) continue;
-				if (bit_global >= start_bit + pin->i_nr_sects) break;
-				assert((fsbuf[i] >> k & 1) == 1);
-				fsbuf[i] &= ~(1 << k);
-				bits_left--;
-			}
-		}
-		WR_SECT(pin->i_dev, smap_blk0_nr + sect_idx);
-		cur_bit = sect_offset + SECTOR_SIZE * 8;
 	}
-
-	/***************************/
-	/* clear the i-node itself */
-	/***************************/
-	pin->i_mode = 0;
-	pin->i_size = 0;
-	pin->i_start_sect = 0;
-	pin->i_nr_sects = 0;
-	sync_inode(pin);
-	/* release slot in inode_table[] */
-	put_inode(pin);
-
-	/************************************************/
-	/* set the inode-nr to 0 in the directory entry */
-	/************************************************/
-	int dir_blk0_nr = dir_inode->i_start_sect;
-	int nr_dir_blks = (dir_inode->i_size + SECTOR_SIZE) / SECTOR_SIZE;
-	int nr_dir_entries =
-		dir_inode->i_size / DIR_ENTRY_SIZE; /* including unused slots
-						     * (the file has been
-						     * deleted but the slot
-						     * is still there)
-						     */
-	int m = 0;
-	struct dir_entry * pde = 0;
-	int flg = 0;
-	int dir_size = 0;
-
-	for (int i = 0; i < nr_dir_blks; i++) {
-		RD_SECT(dir_inode->i_dev, dir_blk0_nr + i);
-
-		pde = (struct dir_entry *)fsbuf;
-		int j;
-		for (j = 0; j < SECTOR_SIZE / DIR_ENTRY_SIZE; j++,pde++) {
-			if (++m > nr_dir_entries)
-				break;
-
-			if (pde->inode_nr == inode_nr) {
-				/* pde->inode_nr = 0; */
-				memset(pde, 0, DIR_ENTRY_SIZE);
-				WR_SECT(dir_inode->i_dev, dir_blk0_nr + i);
-				flg = 1;
-				break;
-			}
-
-			if (pde->inode_nr != INVALID_INODE)
-				dir_size += DIR_ENTRY_SIZE;
-		}
-
-		if (m > nr_dir_entries || /* all entries have been iterated OR */
-		    flg) /* file is found */
-			break;
-	}
-	assert(flg);
-	if (m == nr_dir_entries) { /* the file is the last one in the dir */
-		dir_inode->i_size = dir_size;
-		sync_inode(dir_inode);
+	else if (mode == I_DIRECTORY && !dir_is_empty(pin)) {
+		printl("{FS} cannot remove directory %s, because "
+		       "it is not empty.\n", pathname);
 	}
+	else {
+		/* forget the names in the directory */
+		if (mode == I_DIRECTORY)
+			dcache_purge(pin);
+
+		/*************************/
+		/* free the bit in i-map */
+		/*************************/
+		free_imap_bit(pin->i_dev, inode_nr);
+
+		/**************************/
+		/* free the bits in s-map */
+		/**************************/
+		free_extents(pin);
+
+		/***************************/
+		/* clear the i-node itself */
+		/***************************/
+		pin->i_mode = 0;
+		pin->i_size = 0;
+		sync_inode(pin);
+
+		/*************************************/
+		/* remove the entry in the directory */
+		/*************************************/
+		ret = dir_remove(dir_inode, filename);
+		assert(ret == 0);
 #ifdef ENABLE_DISK_LOG
-	syslog("PROCESS: deleted file '%s' by pid:%d\n", pathname, src);	
+		logev(LOG_UNLINK, src, 1, log_str(pathname));
 #endif
-	return 0;
-}
+	}
 
+	/* release slots in inode_table[] */
+	put_inode(pin);
+	put_inode(dir_inode);
+	return ret;
+}
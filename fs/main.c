@@ -29,6 +29,12 @@
 
 PRIVATE void init_fs();
 PRIVATE void mkfs();
+PRIVATE void migrate_v1(int dev);
+PRIVATE void migrate_v2(int dev);
+PRIVATE void init_inode_table();
+PRIVATE void unhash_inode(struct inode* p);
+PRIVATE void lru_remove_inode(struct inode* p);
+PRIVATE void lru_append_inode(struct inode* p);
 PRIVATE void read_super_block(int dev);
 PRIVATE int fs_fork();
 PRIVATE int fs_exit();
@@ -55,6 +61,20 @@ PUBLIC void task_fs() {
         pcaller = &proc_table[src];
 
         switch (msgtype) {
+            case HARD_INT:
+                /* sent by clock_handler() periodically, no reply */
+#ifdef ENABLE_DISK_LOG
+                disklog_flush();
+#endif
+                bsync();
+                continue;
+            case SYNC:
+#ifdef ENABLE_DISK_LOG
+                disklog_flush();
+#endif
+                bsync();
+                fs_msg.RETVAL = 0;
+                break;
             case OPEN:
                 fs_msg.FD = do_open();
                 break;
@@ -68,6 +88,15 @@ PUBLIC void task_fs() {
             case UNLINK:
                 fs_msg.RETVAL = do_unlink();
                 break;
+            case MKDIR:
+                fs_msg.RETVAL = do_mkdir();
+                break;
+            case RMDIR:
+                fs_msg.RETVAL = do_rmdir();
+                break;
+            case CHDIR:
+                fs_msg.RETVAL = do_chdir();
+                break;
             case RESUME_PROC:
                 src = fs_msg.PROC_NR;
                 break;
@@ -83,10 +112,11 @@ PUBLIC void task_fs() {
             case STAT:
                 fs_msg.RETVAL = do_stat();
                 break;
-            case SEARCH:
-                // printl("fs_msg.pBug in main address is %d\n", fs_msg.pBUF);
-                // printl("BUF in main: %s\n", fs_msg.pBUF);
-                do_search_dir();
+            case READDIR:
+                fs_msg.RETVAL = do_readdir();
+                break;
+            case IO_ENTER:
+                fs_msg.RETVAL = do_io_enter();
                 break;
             case PROPRINT:
                 // printl("fs_msg.pBug in main address is %d\n", fs_msg.pBUF);
@@ -134,11 +164,11 @@ PUBLIC void task_fs() {
                 break;
         }
 #ifdef ENABLE_DISK_LOG
-	    if(KEYlog !=0){syslog("---TTY--: switched to TTY%d\n", KEYlog-1);}
+	    if(KEYlog !=0){logev(LOG_TTY, 0, 1, KEYlog-1);}
         KEYlog = 0;
 	#endif
 #ifdef ENABLE_DISK_LOG
-	    if(SYSlog !=0){syslog("---SYS--: check\n");}
+	    if(SYSlog !=0){logev(LOG_SYS_CHECK, 0, 0);}
         SYSlog = 0;
 #endif  
 
@@ -208,14 +238,19 @@ PRIVATE void init_fs() {
         memset(&f_desc_table[i], 0, sizeof(struct file_desc));
 
     /* inode_table[] */
-    for (i = 0; i < NR_INODE; i++)
-        memset(&inode_table[i], 0, sizeof(struct inode));
+    init_inode_table();
 
     /* super_block[] */
     struct super_block* sb = super_block;
     for (; sb < &super_block[NR_SUPER_BLOCK]; sb++)
         sb->sb_dev = NO_DEV;
 
+    /* buffer cache */
+    init_buffer();
+
+    /* name cache */
+    init_dcache();
+
     /* open the device: hard disk */
     MESSAGE driver_msg;
     driver_msg.type = DEV_OPEN;
@@ -224,10 +259,11 @@ PRIVATE void init_fs() {
     send_recv(BOTH, dd_map[MAJOR(ROOT_DEV)].driver_nr, &driver_msg);
 
     /* read the super block of ROOT DEVICE */
-    RD_SECT(ROOT_DEV, 1);
+    struct buf* bp = bread(ROOT_DEV, 1);
+    int magic = ((struct super_block*)bp->b_data)->magic;
+    brelse(bp);
 
-    sb = (struct super_block*)fsbuf;
-    if (sb->magic != MAGIC_V1) {
+    if (magic != MAGIC_V1 && magic != MAGIC_V2 && magic != MAGIC_V3) {
         printl("{FS} mkfs\n");
         mkfs(); /* make FS */
     }
@@ -236,9 +272,22 @@ PRIVATE void init_fs() {
     read_super_block(ROOT_DEV);
 
     sb = get_super_block(ROOT_DEV);
-    assert(sb->magic == MAGIC_V1);
+    init_bitmaps(ROOT_DEV);
+    if (sb->magic == MAGIC_V1) {
+        printl("{FS} converting FS v1.0 to v2.0\n");
+        migrate_v1(ROOT_DEV);
+    }
+    if (sb->magic == MAGIC_V2) {
+        printl("{FS} converting FS v2.0 to v3.0\n");
+        migrate_v2(ROOT_DEV);
+    }
+    assert(sb->magic == MAGIC_V3);
 
     root_inode = get_inode(ROOT_DEV, ROOT_INODE);
+
+#ifdef ENABLE_DISK_LOG
+    init_disklog();
+#endif
 }
 
 /*****************************************************************************
@@ -256,6 +305,7 @@ PRIVATE void init_fs() {
  *****************************************************************************/
 PRIVATE void mkfs() {
     MESSAGE driver_msg;
+    struct buf* bp;
     int i, j;
 
     /************************/
@@ -276,7 +326,7 @@ PRIVATE void mkfs() {
     int bits_per_sect = SECTOR_SIZE * 8; /* 8 bits per byte */
     /* generate a super block */
     struct super_block sb;
-    sb.magic = MAGIC_V1; /* 0x111 */
+    sb.magic = MAGIC_V3; /* 0x113 */
     sb.nr_inodes = bits_per_sect;
     sb.nr_inode_sects = sb.nr_inodes * INODE_SIZE / SECTOR_SIZE;
     sb.nr_sects = geo.size; /* partition size in sector */
@@ -294,11 +344,13 @@ PRIVATE void mkfs() {
     sb.dir_ent_inode_off = (int)&de.inode_nr - (int)&de;
     sb.dir_ent_fname_off = (int)&de.name - (int)&de;
 
-    memset(fsbuf, 0x90, SECTOR_SIZE);
-    memcpy(fsbuf, &sb, SUPER_BLOCK_SIZE);
+    bp = getblk(ROOT_DEV, 1);
+    memset(bp->b_data, 0x90, SECTOR_SIZE);
+    memcpy(bp->b_data, &sb, SUPER_BLOCK_SIZE);
 
     /* write the super block */
-    WR_SECT(ROOT_DEV, 1);
+    bwrite(bp);
+    brelse(bp);
 
     printl(
         "{FS} devbase:0x%x00, sb:0x%x00, imap:0x%x00, smap:0x%x00\n"
@@ -311,11 +363,12 @@ PRIVATE void mkfs() {
     /************************/
     /*       inode map      */
     /************************/
-    memset(fsbuf, 0, SECTOR_SIZE);
+    bp = getblk(ROOT_DEV, 2);
+    memset(bp->b_data, 0, SECTOR_SIZE);
     for (i = 0; i < (NR_CONSOLES + 3); i++)
-        fsbuf[0] |= 1 << i;
+        bp->b_data[0] |= 1 << i;
 
-    assert(fsbuf[0] == 0x3F); /* 0011 1111 :
+    assert(bp->b_data[0] == 0x3F); /* 0011 1111 :
                                *   || ||||
                                *   || |||`--- bit 0 : reserved
                                *   || ||`---- bit 1 : the first inode,
@@ -325,93 +378,108 @@ PRIVATE void mkfs() {
                                *   |`-------- bit 4 : /dev_tty2
                                *   `--------- bit 5 : /cmd.tar
                                */
-    WR_SECT(ROOT_DEV, 2);
+    bwrite(bp);
+    brelse(bp);
 
     /************************/
     /*      secter map      */
     /************************/
-    memset(fsbuf, 0, SECTOR_SIZE);
+    bp = getblk(ROOT_DEV, 2 + sb.nr_imap_sects);
+    memset(bp->b_data, 0, SECTOR_SIZE);
     int nr_sects = NR_DEFAULT_FILE_SECTS + 1;
     /*             ~~~~~~~~~~~~~~~~~~~|~   |
      *                                |    `--- bit 0 is reserved
      *                                `-------- for `/'
      */
     for (i = 0; i < nr_sects / 8; i++)
-        fsbuf[i] = 0xFF;
+        bp->b_data[i] = 0xFF;
 
     for (j = 0; j < nr_sects % 8; j++)
-        fsbuf[i] |= (1 << j);
+        bp->b_data[i] |= (1 << j);
 
-    WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects);
+    bwrite(bp);
+    brelse(bp);
 
     /* zeromemory the rest sector-map */
-    memset(fsbuf, 0, SECTOR_SIZE);
-    for (i = 1; i < sb.nr_smap_sects; i++)
-        WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + i);
+    for (i = 1; i < sb.nr_smap_sects; i++) {
+        bp = getblk(ROOT_DEV, 2 + sb.nr_imap_sects + i);
+        memset(bp->b_data, 0, SECTOR_SIZE);
+        bwrite(bp);
+        brelse(bp);
+    }
 
     /* cmd.tar */
     /* make sure it'll not be overwritten by the disk log */
     assert(INSTALL_START_SECT + INSTALL_NR_SECTS <
            sb.nr_sects - NR_SECTS_FOR_LOG);
-    int bit_offset = INSTALL_START_SECT - sb.n_1st_sect +
-                     1; /* sect M <-> bit (M - sb.n_1stsect + 1) */
+    int bit_offset =
+        INSTALL_START_SECT - sb.n_1st_sect; /* sect M <-> bit (M - sb.n_1st_sect) */
     int bit_off_in_sect = bit_offset % (SECTOR_SIZE * 8);
     int bit_left = INSTALL_NR_SECTS;
     int cur_sect = bit_offset / (SECTOR_SIZE * 8);
-    RD_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
+    bp = bread(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
     while (bit_left) {
         int byte_off = bit_off_in_sect / 8;
         /* this line is ineffecient in a loop, but I don't care */
-        fsbuf[byte_off] |= 1 << (bit_off_in_sect % 8);
+        bp->b_data[byte_off] |= 1 << (bit_off_in_sect % 8);
         bit_left--;
         bit_off_in_sect++;
         if (bit_off_in_sect == (SECTOR_SIZE * 8)) {
-            WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
+            bwrite(bp);
+            brelse(bp);
             cur_sect++;
-            RD_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
+            bp = bread(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
             bit_off_in_sect = 0;
         }
     }
-    WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + cur_sect);
+    bwrite(bp);
+    brelse(bp);
 
     /************************/
     /*       inodes         */
     /************************/
     /* inode of `/' */
-    memset(fsbuf, 0, SECTOR_SIZE);
-    struct inode* pi = (struct inode*)fsbuf;
+    bp = getblk(ROOT_DEV, 2 + sb.nr_imap_sects + sb.nr_smap_sects);
+    memset(bp->b_data, 0, SECTOR_SIZE);
+    struct inode* pi = (struct inode*)bp->b_data;
     pi->i_mode = I_DIRECTORY;
-    pi->i_size = DIR_ENTRY_SIZE * 5; /* 5 files:
-                                      * `.',
-                                      * `dev_tty0', `dev_tty1', `dev_tty2',
-                                      * `cmd.tar'
-                                      */
+    pi->i_size = DIR_SECTS * SECTOR_SIZE; /* the head sector holds 6 files:
+                                           * `.', `..',
+                                           * `dev_tty0', `dev_tty1',
+                                           * `dev_tty2', `cmd.tar'
+                                           */
     pi->i_start_sect = sb.n_1st_sect;
     pi->i_nr_sects = NR_DEFAULT_FILE_SECTS;
+    pi->i_nr_exts = 1;
     /* inode of `/dev_tty0~2' */
     for (i = 0; i < NR_CONSOLES; i++) {
-        pi = (struct inode*)(fsbuf + (INODE_SIZE * (i + 1)));
+        pi = (struct inode*)(bp->b_data + (INODE_SIZE * (i + 1)));
         pi->i_mode = I_CHAR_SPECIAL;
         pi->i_size = 0;
         pi->i_start_sect = MAKE_DEV(DEV_CHAR_TTY, i);
         pi->i_nr_sects = 0;
     }
     /* inode of `/cmd.tar' */
-    pi = (struct inode*)(fsbuf + (INODE_SIZE * (NR_CONSOLES + 1)));
+    pi = (struct inode*)(bp->b_data + (INODE_SIZE * (NR_CONSOLES + 1)));
     pi->i_mode = I_REGULAR;
     pi->i_size = INSTALL_NR_SECTS * SECTOR_SIZE;
     pi->i_start_sect = INSTALL_START_SECT;
     pi->i_nr_sects = INSTALL_NR_SECTS;
-    WR_SECT(ROOT_DEV, 2 + sb.nr_imap_sects + sb.nr_smap_sects);
+    pi->i_nr_exts = 1;
+    bwrite(bp);
+    brelse(bp);
 
     /************************/
     /*          `/'         */
     /************************/
-    memset(fsbuf, 0, SECTOR_SIZE);
-    struct dir_entry* pde = (struct dir_entry*)fsbuf;
+    bp = getblk(ROOT_DEV, sb.n_1st_sect);
+    memset(bp->b_data, 0, SECTOR_SIZE);
+    struct dir_entry* pde = (struct dir_entry*)bp->b_data;
 
     pde->inode_nr = 1;
     strcpy(pde->name, ".");
+    (++pde)->inode_nr = 1;
+    strcpy(pde->name, "..");
 
     /* dir entries of `/dev_tty0~2' */
     for (i = 0; i < NR_CONSOLES; i++) {
@@ -421,7 +489,143 @@ PRIVATE void mkfs() {
     }
     (++pde)->inode_nr = NR_CONSOLES + 2;
     sprintf(pde->name, "cmd.tar", i);
-    WR_SECT(ROOT_DEV, sb.n_1st_sect);
+    bwrite(bp);
+    brelse(bp);
+
+    /* the buckets are empty */
+    for (i = 1; i < DIR_SECTS; i++) {
+        bp = getblk(ROOT_DEV, sb.n_1st_sect + i);
+        memset(bp->b_data, 0, SECTOR_SIZE);
+        bwrite(bp);
+        brelse(bp);
+    }
+}
+
+/*****************************************************************************
+ *                                migrate_v1
+ *****************************************************************************/
+/**
+ * <Ring 1> Convert a v1.0 FS to v2.0. In v1.0 every file took
+ * NR_DEFAULT_FILE_SECTS sectors whether it needed them or not. Now
+ *          - A regular file keeps only the sectors holding its data, as
+ *            extent 0.
+ *          - A directory keeps all its sectors, since the boot loader reads
+ *            `/' from one extent.
+ *          - The sector-map is rebuilt from the extents.
+ *
+ * @param dev  The device.
+ *****************************************************************************/
+PRIVATE void migrate_v1(int dev) {
+    struct super_block* sb = get_super_block(dev);
+    int inode_blk0_nr = 1 + 1 + sb->nr_imap_sects + sb->nr_smap_sects;
+    struct buf* bp;
+    int i, j;
+
+    /* zeromemory the sector-map */
+    for (i = 0; i < sb->nr_smap_sects; i++) {
+        bp = getblk(dev, 1 + 1 + sb->nr_imap_sects + i);
+        memset(bp->b_data, 0, SECTOR_SIZE);
+        bdwrite(bp);
+        brelse(bp);
+    }
+
+    for (i = 0; i < sb->nr_inode_sects; i++) {
+        bp = bread(dev, inode_blk0_nr + i);
+        for (j = 0; j < SECTOR_SIZE / INODE_SIZE; j++) {
+            struct inode* pi = (struct inode*)(bp->b_data + j * INODE_SIZE);
+            int imode = pi->i_mode & I_TYPE_MASK;
+
+            memset(pi->i_ext, 0, sizeof(pi->i_ext));
+            pi->i_ext_sect = 0;
+            pi->i_nr_exts = 0;
+
+            if (imode == I_REGULAR) {
+                int nr_sects = (pi->i_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+                pi->i_nr_sects = min(pi->i_nr_sects, nr_sects);
+                if (pi->i_nr_sects == 0)
+                    pi->i_start_sect = 0;
+            }
+            if ((imode == I_REGULAR || imode == I_DIRECTORY) &&
+                pi->i_nr_sects) {
+                pi->i_nr_exts = 1;
+                set_smap_bits(dev, pi->i_start_sect, pi->i_nr_sects, 1);
+            }
+        }
+        bdwrite(bp);
+        brelse(bp);
+    }
+
+    /* the new magic must not reach the disk before the new inodes do */
+    bsync();
+
+    sb->magic = MAGIC_V2;
+    bp = bread(dev, 1);
+    ((struct super_block*)bp->b_data)->magic = MAGIC_V2;
+    bwrite(bp);
+    brelse(bp);
+}
+
+/*****************************************************************************
+ *                                migrate_v2
+ *****************************************************************************/
+/**
+ * <Ring 1> Convert a v2.0 FS to v3.0. In v2.0 `/' was the only directory,
+ * a plain array of entries. It is rebuilt as a hashed directory (see
+ * NR_DIR_BUCKETS), with its entries added in their old order so that the
+ * ones the boot loader looks for stay in the head sector.
+ *
+ * @param dev  The device.
+ *****************************************************************************/
+PRIVATE void migrate_v2(int dev) {
+    struct super_block* sb = get_super_block(dev);
+    struct inode* dir = get_inode(dev, ROOT_INODE);
+    /* the lower half of fsbuf is left to dir_add() for growing `/' */
+    struct dir_entry* ents = (struct dir_entry*)(fsbuf + FSBUF_SIZE / 2);
+    int nr_ents = 0;
+    int has_parent = 0;
+    int i, j;
+
+    /* save the live entries */
+    int nr_old_ents = dir->i_size / DIR_ENTRY_SIZE;
+    for (i = 0; i * DIR_ENTS_PER_SECT < nr_old_ents; i++) {
+        struct buf* bp = bread(dev, bmap(dir, i, 0));
+        struct dir_entry* pde = (struct dir_entry*)bp->b_data;
+        for (j = 0; j < DIR_ENTS_PER_SECT &&
+                    i * DIR_ENTS_PER_SECT + j < nr_old_ents; j++, pde++) {
+            if (pde->inode_nr == INVALID_INODE)
+                continue;
+            assert((nr_ents + 1) * DIR_ENTRY_SIZE <= FSBUF_SIZE / 2);
+            ents[nr_ents++] = *pde;
+            if (strcmp(pde->name, "..") == 0)
+                has_parent = 1;
+        }
+        brelse(bp);
+    }
+
+    /* clear the directory */
+    if (clear_dir(dir, DIR_SECTS) != 0)
+        panic("no room to convert `/'");
+
+    /* put the entries back */
+    char name[MAX_FILENAME_LEN + 1];
+    for (i = 0; i < nr_ents; i++) {
+        memcpy(name, ents[i].name, MAX_FILENAME_LEN);
+        name[MAX_FILENAME_LEN] = 0;
+        if (dir_add(dir, name, ents[i].inode_nr) != 0)
+            panic("too many files in `/'");
+        if (i == 0 && !has_parent)
+            dir_add(dir, "..", ROOT_INODE);
+    }
+    put_inode(dir);
+
+    /* the new magic must not reach the disk before the new `/' does */
+    bsync();
+
+    sb->magic = MAGIC_V3;
+    struct buf* bp = bread(dev, 1);
+    ((struct super_block*)bp->b_data)->magic = MAGIC_V3;
+    bwrite(bp);
+    brelse(bp);
 }
 
 /*****************************************************************************
@@ -459,6 +663,61 @@ PUBLIC int rw_sector(int io_type,
     return 0;
 }
 
+/*****************************************************************************
+ *                                rw_sector_async
+ *****************************************************************************/
+/**
+ * <Ring 1> Submit a R/W request to the driver without waiting for it. The
+ * driver may sort and merge the requests submitted in a row. The buffer
+ * must be left alone until rw_sector_wait() returns.
+ *
+ * @param io_type  DEV_READ or DEV_WRITE
+ * @param dev      device nr
+ * @param pos      Byte offset from/to where to r/w.
+ * @param bytes    r/w count in bytes.
+ * @param proc_nr  To whom the buffer belongs.
+ * @param buf      r/w buffer.
+ *
+ * @return Request id, which is to be passed to rw_sector_wait().
+ *****************************************************************************/
+PUBLIC int rw_sector_async(int io_type,
+                           int dev,
+                           u64 pos,
+                           int bytes,
+                           int proc_nr,
+                           void* buf) {
+    MESSAGE driver_msg;
+
+    driver_msg.type = io_type == DEV_READ ? DEV_READ_ASYNC : DEV_WRITE_ASYNC;
+    driver_msg.DEVICE = MINOR(dev);
+    driver_msg.POSITION = pos;
+    driver_msg.BUF = buf;
+    driver_msg.CNT = bytes;
+    driver_msg.PROC_NR = proc_nr;
+    assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
+    send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+
+    return driver_msg.REQUEST;
+}
+
+/*****************************************************************************
+ *                                rw_sector_wait
+ *****************************************************************************/
+/**
+ * <Ring 1> Wait for a request submitted by rw_sector_async() to complete.
+ *
+ * @param dev     device nr
+ * @param req_id  What rw_sector_async() returned.
+ *****************************************************************************/
+PUBLIC void rw_sector_wait(int dev, int req_id) {
+    MESSAGE driver_msg;
+
+    driver_msg.type = DEV_WAIT;
+    driver_msg.REQUEST = req_id;
+    assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
+    send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+}
+
 /*****************************************************************************
  *                                read_super_block
  *****************************************************************************/
@@ -470,16 +729,7 @@ PUBLIC int rw_sector(int io_type,
  *****************************************************************************/
 PRIVATE void read_super_block(int dev) {
     int i;
-    MESSAGE driver_msg;
-
-    driver_msg.type = DEV_READ;
-    driver_msg.DEVICE = MINOR(dev);
-    driver_msg.POSITION = SECTOR_SIZE * 1;
-    driver_msg.BUF = fsbuf;
-    driver_msg.CNT = SECTOR_SIZE;
-    driver_msg.PROC_NR = TASK_FS;
-    assert(dd_map[MAJOR(dev)].driver_nr != INVALID_DRIVER);
-    send_recv(BOTH, dd_map[MAJOR(dev)].driver_nr, &driver_msg);
+    struct buf* bp = bread(dev, 1);
 
     /* find a free slot in super_block[] */
     for (i = 0; i < NR_SUPER_BLOCK; i++)
@@ -490,10 +740,12 @@ PRIVATE void read_super_block(int dev) {
 
     assert(i == 0); /* currently we use only the 1st slot */
 
-    struct super_block* psb = (struct super_block*)fsbuf;
+    struct super_block* psb = (struct super_block*)bp->b_data;
 
-    super_block[i] = *psb;
+    memcpy(&super_block[i], psb, SUPER_BLOCK_SIZE);
     super_block[i].sb_dev = dev;
+
+    brelse(bp);
 }
 
 /*****************************************************************************
@@ -517,13 +769,44 @@ PUBLIC struct super_block* get_super_block(int dev) {
     return 0;
 }
 
+/**
+ * Unreferenced inodes (i_cnt == 0) of inode_table[] are kept in this LRU
+ * list. The free slots are at the head, then the cached inodes with the
+ * least recently released one first. inode_lru.i_next is the slot to be
+ * recycled next.
+ */
+PRIVATE struct inode inode_lru;
+PRIVATE struct inode* inode_hash[NR_INODE_HASH];
+
+#define INODE_HASH(dev, num) \
+    ((((u32)(dev) << 4) ^ (u32)(num)) & (NR_INODE_HASH - 1))
+
+/*****************************************************************************
+ *                                init_inode_table
+ *****************************************************************************/
+/**
+ * <Ring 1> All slots of inode_table[] are free and in the LRU list.
+ *
+ *****************************************************************************/
+PRIVATE void init_inode_table() {
+    int i;
+
+    memset(inode_table, 0, sizeof(inode_table));
+    memset(inode_hash, 0, sizeof(inode_hash));
+
+    inode_lru.i_prev = inode_lru.i_next = &inode_lru;
+    for (i = 0; i < NR_INODE; i++)
+        lru_append_inode(&inode_table[i]);
+}
+
 /*****************************************************************************
  *                                get_inode
  *****************************************************************************/
 /**
  * <Ring 1> Get the inode ptr of given inode nr. A cache -- inode_table[] -- is
  * maintained to make things faster. If the inode requested is already there,
- * just return it. Otherwise the inode will be read from the disk.
+ * just return it, even if nobody is using it. Otherwise the slot of the least
+ * recently released inode is recycled and the inode is read from the disk.
  *
  * @param dev Device nr.
  * @param num I-node nr.
@@ -534,39 +817,46 @@ PUBLIC struct inode* get_inode(int dev, int num) {
     if (num == 0)
         return 0;
 
-    struct inode* p;
-    struct inode* q = 0;
-    for (p = &inode_table[0]; p < &inode_table[NR_INODE]; p++) {
-        if (p->i_cnt) { /* not a free slot */
-            if ((p->i_dev == dev) && (p->i_num == num)) {
-                /* this is the inode we want */
-                p->i_cnt++;
-                return p;
-            }
-        } else {       /* a free slot */
-            if (!q)    /* q hasn't been assigned yet */
-                q = p; /* q <- the 1st free slot */
+    struct inode* p = inode_hash[INODE_HASH(dev, num)];
+    for (; p; p = p->i_hnext) {
+        if ((p->i_dev == dev) && (p->i_num == num)) {
+            /* this is the inode we want */
+            if (p->i_cnt++ == 0)
+                lru_remove_inode(p);
+            return p;
         }
     }
 
-    if (!q)
+    struct inode* q = inode_lru.i_next;
+    if (q == &inode_lru)
         panic("the inode table is full");
 
+    lru_remove_inode(q);
+    if (q->i_num)
+        unhash_inode(q);
+
     q->i_dev = dev;
     q->i_num = num;
     q->i_cnt = 1;
+    q->i_hnext = inode_hash[INODE_HASH(dev, num)];
+    inode_hash[INODE_HASH(dev, num)] = q;
 
     struct super_block* sb = get_super_block(dev);
     int blk_nr = 1 + 1 + sb->nr_imap_sects + sb->nr_smap_sects +
                  ((num - 1) / (SECTOR_SIZE / INODE_SIZE));
-    RD_SECT(dev, blk_nr);
+    struct buf* bp = bread(dev, blk_nr);
     struct inode* pinode =
-        (struct inode*)((u8*)fsbuf +
+        (struct inode*)(bp->b_data +
                         ((num - 1) % (SECTOR_SIZE / INODE_SIZE)) * INODE_SIZE);
     q->i_mode = pinode->i_mode;
     q->i_size = pinode->i_size;
     q->i_start_sect = pinode->i_start_sect;
     q->i_nr_sects = pinode->i_nr_sects;
+    memcpy(q->i_ext, pinode->i_ext, sizeof(q->i_ext));
+    q->i_ext_sect = pinode->i_ext_sect;
+    q->i_nr_exts = pinode->i_nr_exts;
+    q->i_nr_ents = -1;
+    brelse(bp);
     return q;
 }
 
@@ -575,14 +865,67 @@ PUBLIC struct inode* get_inode(int dev, int num) {
  *****************************************************************************/
 /**
  * Decrease the reference nr of a slot in inode_table[]. When the nr reaches
- * zero, it means the inode is not used any more and can be overwritten by
- * a new inode.
+ * zero, it means the inode is not used any more. It stays cached until the
+ * slot is recycled for another inode.
  *
  * @param pinode I-node ptr.
  *****************************************************************************/
 PUBLIC void put_inode(struct inode* pinode) {
     assert(pinode->i_cnt > 0);
-    pinode->i_cnt--;
+    if (--pinode->i_cnt == 0)
+        lru_append_inode(pinode);
+}
+
+/*****************************************************************************
+ *                                unhash_inode
+ *****************************************************************************/
+/**
+ * <Ring 1> Remove an inode from its hash chain.
+ *
+ * @param p I-node ptr.
+ *****************************************************************************/
+PRIVATE void unhash_inode(struct inode* p) {
+    struct inode** pp = &inode_hash[INODE_HASH(p->i_dev, p->i_num)];
+
+    for (; *pp; pp = &(*pp)->i_hnext) {
+        if (*pp == p) {
+            *pp = p->i_hnext;
+            p->i_hnext = 0;
+            return;
+        }
+    }
+
+    assert(0);
+}
+
+/*****************************************************************************
+ *                                lru_remove_inode
+ *****************************************************************************/
+/**
+ * <Ring 1> Unlink an inode from the LRU list.
+ *
+ * @param p I-node ptr.
+ *****************************************************************************/
+PRIVATE void lru_remove_inode(struct inode* p) {
+    p->i_prev->i_next = p->i_next;
+    p->i_next->i_prev = p->i_prev;
+    p->i_prev = p->i_next = 0;
+}
+
+/*****************************************************************************
+ *                                lru_append_inode
+ *****************************************************************************/
+/**
+ * <Ring 1> Put an inode at the tail (the most recently released end) of the
+ * LRU list.
+ *
+ * @param p I-node ptr.
+ *****************************************************************************/
+PRIVATE void lru_append_inode(struct inode* p) {
+    p->i_next = &inode_lru;
+    p->i_prev = inode_lru.i_prev;
+    inode_lru.i_prev->i_next = p;
+    inode_lru.i_prev = p;
 }
 
 /*****************************************************************************
@@ -599,15 +942,19 @@ PUBLIC void sync_inode(struct inode* p) {
     struct super_block* sb = get_super_block(p->i_dev);
     int blk_nr = 1 + 1 + sb->nr_imap_sects + sb->nr_smap_sects +
                  ((p->i_num - 1) / (SECTOR_SIZE / INODE_SIZE));
-    RD_SECT(p->i_dev, blk_nr);
-    pinode = (struct inode*)((u8*)fsbuf +
+    struct buf* bp = bread(p->i_dev, blk_nr);
+    pinode = (struct inode*)(bp->b_data +
                              (((p->i_num - 1) % (SECTOR_SIZE / INODE_SIZE)) *
                               INODE_SIZE));
     pinode->i_mode = p->i_mode;
     pinode->i_size = p->i_size;
     pinode->i_start_sect = p->i_start_sect;
     pinode->i_nr_sects = p->i_nr_sects;
-    WR_SECT(p->i_dev, blk_nr);
+    memcpy(pinode->i_ext, p->i_ext, sizeof(pinode->i_ext));
+    pinode->i_ext_sect = p->i_ext_sect;
+    pinode->i_nr_exts = p->i_nr_exts;
+    bdwrite(bp);
+    brelse(bp);
 }
 
 /*****************************************************************************
@@ -627,8 +974,10 @@ PRIVATE int fs_fork() {
             child->filp[i]->fd_inode->i_cnt++;
         }
     }
+    if (child->cwd)
+        child->cwd->i_cnt++;
     #ifdef ENABLE_DISK_LOG
-	syslog("PROCESS: forked new process, child pid: %d\n", fs_msg.PID);
+	logev(LOG_FORK, fs_msg.PID, 0);
 	#endif
     return 0;
 }
@@ -643,19 +992,23 @@ PRIVATE int fs_fork() {
  *****************************************************************************/
 PRIVATE int fs_exit() {
     #ifdef ENABLE_DISK_LOG
-	syslog("PROCESS: exit process, pid: %d\n", fs_msg.PID);	
+	logev(LOG_EXIT, fs_msg.PID, 0);
 	#endif
     int i;
     struct proc* p = &proc_table[fs_msg.PID];
     for (i = 0; i < NR_FILES; i++) {
         if (p->filp[i]) {
             /* release the inode */
-            p->filp[i]->fd_inode->i_cnt--;
+            put_inode(p->filp[i]->fd_inode);
             /* release the file desc slot */
             if (--p->filp[i]->fd_cnt == 0)
                 p->filp[i]->fd_inode = 0;
             p->filp[i] = 0;
         }
     }
+    if (p->cwd) {
+        put_inode(p->cwd);
+        p->cwd = 0;
+    }
     return 0;
 }
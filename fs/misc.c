@@ -29,6 +29,8 @@
 #include "hd.h"
 #include "fs.h"
 
+PRIVATE void fill_stat(struct inode* pin, struct stat* s);
+
 /*****************************************************************************
  *                                do_stat
  *************************************************************************//**
@@ -69,13 +71,10 @@ PUBLIC int do_stat() {
         assert(0);
     }
     pin = get_inode(dir_inode->i_dev, inode_nr);
+    put_inode(dir_inode);
 
     struct stat s; /* the thing requested */
-    s.st_dev = pin->i_dev;
-    s.st_ino = pin->i_num;
-    s.st_mode = pin->i_mode;
-    s.st_rdev = is_special(pin->i_mode) ? pin->i_start_sect : NO_DEV;
-    s.st_size = pin->i_size;
+    fill_stat(pin, &s);
 
     put_inode(pin);
 
@@ -86,86 +85,193 @@ PUBLIC int do_stat() {
     return 0;
 }
 
+/*****************************************************************************
+ *                                do_chdir
+ *************************************************************************//**
+ * Perform the chdir() syscall.
+ * 
+ * @return  On success, zero is returned. On error, -1 is returned.
+ *****************************************************************************/
+PUBLIC int do_chdir() {
+    char pathname[MAX_PATH]; /* parameter from the caller */
+
+    /* get parameters from the message */
+    int name_len = fs_msg.NAME_LEN; /* length of filename */
+    int src = fs_msg.source;        /* caller proc nr. */
+    assert(name_len < MAX_PATH);
+    phys_copy((void*)va2la(TASK_FS, pathname),    /* to   */
+              (void*)va2la(src, fs_msg.PATHNAME), /* from */
+              name_len);
+    pathname[name_len] = 0; /* terminate the string */
+
+    int inode_nr = search_file(pathname);
+    if (inode_nr == INVALID_INODE) {
+        printl("{FS} FS::do_chdir():: no such directory: %s\n", pathname);
+        return -1;
+    }
+
+    struct inode* pin = get_inode(root_inode->i_dev, inode_nr);
+    if (pin->i_mode != I_DIRECTORY) {
+        printl("{FS} FS::do_chdir():: not a directory: %s\n", pathname);
+        put_inode(pin);
+        return -1;
+    }
+
+    /* the current directory is held until it is changed again */
+    if (pcaller->cwd)
+        put_inode(pcaller->cwd);
+    pcaller->cwd = pin;
+
+    return 0;
+}
+
+/*****************************************************************************
+ *                                do_readdir
+ *************************************************************************//**
+ * Perform the readdir() syscall: copy a batch of the entries of a directory,
+ * along with the status of their files, to the caller.
+ *
+ * The cursor in fs_msg.POSITION is the slot in the directory to start from
+ * (0 for the beginning). It is set to the slot after the last entry copied.
+ * Entries added or removed meanwhile may or may not be seen.
+ * 
+ * @return  How many entries are copied, 0 if there is no more. On error, -1
+ *          is returned.
+ *****************************************************************************/
+PUBLIC int do_readdir() {
+    char pathname[MAX_PATH]; /* parameter from the caller */
+
+    /* get parameters from the message */
+    int name_len = fs_msg.NAME_LEN; /* length of filename */
+    int src = fs_msg.source;        /* caller proc nr. */
+    assert(name_len < MAX_PATH);
+    phys_copy((void*)va2la(TASK_FS, pathname),    /* to   */
+              (void*)va2la(src, fs_msg.PATHNAME), /* from */
+              name_len);
+    pathname[name_len] = 0; /* terminate the string */
+
+    int inode_nr = search_file(pathname);
+    if (inode_nr == INVALID_INODE) {
+        printl("{FS} FS::do_readdir():: no such directory: %s\n", pathname);
+        return -1;
+    }
+
+    struct inode* dir_inode = get_inode(root_inode->i_dev, inode_nr);
+    if (dir_inode->i_mode != I_DIRECTORY) {
+        printl("{FS} FS::do_readdir():: not a directory: %s\n", pathname);
+        put_inode(dir_inode);
+        return -1;
+    }
+
+    /* the entries are gathered in fsbuf and copied out at one time */
+    struct dirent* ents = (struct dirent*)fsbuf;
+    int max_ents = min(fs_msg.BUF_LEN, FSBUF_SIZE) / sizeof(struct dirent);
+    int nr_slots = dir_inode->i_size / DIR_ENTRY_SIZE;
+    int slot = (int)fs_msg.POSITION;
+    int n = 0;
+
+    while (slot < nr_slots && n < max_ents) {
+        struct buf* bp = bread(dir_inode->i_dev,
+                               bmap(dir_inode, slot / DIR_ENTS_PER_SECT, 0));
+        struct dir_entry* pde = (struct dir_entry*)bp->b_data;
+        int j;
+        for (j = slot % DIR_ENTS_PER_SECT;
+             j < DIR_ENTS_PER_SECT && n < max_ents; j++, slot++) {
+            if (pde[j].inode_nr == INVALID_INODE) /* a free slot */
+                continue;
+
+            memcpy(ents[n].d_name, pde[j].name, MAX_FILENAME_LEN);
+            ents[n].d_name[MAX_FILENAME_LEN] = 0;
+
+            struct inode* pin = get_inode(dir_inode->i_dev, pde[j].inode_nr);
+            fill_stat(pin, &ents[n].d_stat);
+            put_inode(pin);
+            n++;
+        }
+        brelse(bp);
+    }
+    put_inode(dir_inode);
+
+    phys_copy((void*)va2la(src, fs_msg.BUF), /* to   */
+              (void*)va2la(TASK_FS, ents),   /* from */
+              n * sizeof(struct dirent));
+    fs_msg.POSITION = slot;
+
+    return n;
+}
+
+/*****************************************************************************
+ *                                fill_stat
+ *****************************************************************************/
+/**
+ * Fill a struct stat with the status of a file.
+ *
+ * @param[in]  pin  I-node of the file.
+ * @param[out] s    The status.
+ *****************************************************************************/
+PRIVATE void fill_stat(struct inode* pin, struct stat* s) {
+    s->st_dev = pin->i_dev;
+    s->st_ino = pin->i_num;
+    s->st_mode = pin->i_mode;
+    s->st_rdev = is_special(pin->i_mode) ? pin->i_start_sect : NO_DEV;
+    s->st_size = pin->i_size;
+}
+
 /*****************************************************************************
  *                                search_file
  *****************************************************************************/
 /**
  * Search the file and return the inode_nr.
  *
- * @param[in] path The full path of the file to search.
- * @return         Ptr to the i-node of the file if successful, otherwise zero.
+ * @param[in] path The path of the file to search.
+ * @return         I-node nr of the file if successful, otherwise zero.
  *
  * @see open()
  * @see do_open()
  *****************************************************************************/
 PUBLIC int search_file(char* path) {
-    int i, j;
-
     char filename[MAX_PATH];
-    memset(filename, 0, MAX_FILENAME_LEN);
     struct inode* dir_inode;
     if (strip_path(filename, path, &dir_inode) != 0)
         return 0;
 
-    if (filename[0] == 0) /* path: "/" */
-        return dir_inode->i_num;
-
-    /**
-     * Search the dir for the file.
-     */
-    int dir_blk0_nr = dir_inode->i_start_sect;
-    int nr_dir_blks = (dir_inode->i_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
-    int nr_dir_entries =
-        dir_inode->i_size / DIR_ENTRY_SIZE; /**
-                                             * including unused slots
-                                             * (the file has been deleted
-                                             * but the slot is still there)
-                                             */
-    int m = 0;
-    struct dir_entry* pde;
-    for (i = 0; i < nr_dir_blks; i++) {
-        RD_SECT(dir_inode->i_dev, dir_blk0_nr + i);
-        pde = (struct dir_entry*)fsbuf;
-        for (j = 0; j < SECTOR_SIZE / DIR_ENTRY_SIZE; j++, pde++) {
-            if (memcmp(filename, pde->name, MAX_FILENAME_LEN) == 0)
-                return pde->inode_nr;
-            if (++m > nr_dir_entries)
-                break;
-        }
-        if (m > nr_dir_entries) /* all entries have been iterated */
-            break;
-    }
+    int inode_nr;
+    if (filename[0] == 0) /* path: "/" or "dir/" */
+        inode_nr = dir_inode->i_num;
+    else
+        inode_nr = dir_lookup(dir_inode, filename);
 
-    /* file not found */
-    return 0;
+    put_inode(dir_inode);
+    return inode_nr;
 }
 
 /*****************************************************************************
  *                                strip_path
  *****************************************************************************/
 /**
- * Get the basename from the fullpath.
- *
- * In Orange'S FS v1.0, all files are stored in the root directory.
- * There is no sub-folder thing.
+ * Get the basename from the path, and the directory in which it is.
  *
  * This routine should be called at the very beginning of file operations
- * such as open(), read() and write(). It accepts the full path and returns
- * two things: the basename and a ptr of the root dir's i-node.
+ * such as open(), read() and write(). It accepts the path and returns
+ * two things: the basename and a ptr of the dir's i-node.
  *
- * e.g. After stip_path(filename, "/blah", ppinode) finishes, we get:
+ * A path beginning with `/' is looked up from the root directory, others
+ * from the current directory of the caller. Every component except the
+ * last one must be a directory.
+ *
+ * e.g. After stip_path(filename, "/usr/blah", ppinode) finishes, we get:
  *      - filename: "blah"
- *      - *ppinode: root_inode
+ *      - *ppinode: the i-node of `/usr'
  *      - ret val:  0 (successful)
  *
- * Currently an acceptable pathname should begin with at most one `/'
- * preceding a filename.
- *
- * Filenames may contain any character except '/' and '\\0'.
+ * The basename is empty for "/" and paths ending with `/'. Filenames may
+ * contain any character except '/' and '\\0', and are truncated to
+ * MAX_FILENAME_LEN characters.
  *
  * @param[out] filename The string for the result.
- * @param[in]  pathname The full pathname.
- * @param[out] ppinode  The ptr of the dir's inode will be stored here.
+ * @param[in]  pathname The path.
+ * @param[out] ppinode  The ptr of the dir's inode will be stored here. It
+ *                      must be released by put_inode().
  *
  * @return Zero if success, otherwise the pathname is not valid.
  *****************************************************************************/
@@ -173,25 +279,45 @@ PUBLIC int strip_path(char* filename,
                       const char* pathname,
                       struct inode** ppinode) {
     const char* s = pathname;
-    char* t = filename;
 
     if (s == 0)
         return -1;
 
-    if (*s == '/')
-        s++;
+    struct inode* dir = root_inode;
+    if (*s != '/' && pcaller->cwd)
+        dir = pcaller->cwd;
+    dir->i_cnt++;
 
-    while (*s) { /* check each character */
-        if (*s == '/')
-            return -1;
-        *t++ = *s++;
-        /* if filename is too long, just truncate it */
-        if (t - filename >= MAX_FILENAME_LEN)
+    while (1) {
+        while (*s == '/')
+            s++;
+
+        char* t = filename;
+        while (*s && *s != '/') { /* check each character */
+            /* if filename is too long, just truncate it */
+            if (t - filename < MAX_FILENAME_LEN)
+                *t++ = *s;
+            s++;
+        }
+        *t = 0;
+
+        if (*s == 0) /* the last component */
             break;
+
+        /* go down into the directory */
+        int inode_nr = dir_lookup(dir, filename);
+        struct inode* pin = get_inode(dir->i_dev, inode_nr);
+        put_inode(dir);
+        if (!pin)
+            return -1;
+        if (pin->i_mode != I_DIRECTORY) {
+            put_inode(pin);
+            return -1;
+        }
+        dir = pin;
     }
-    *t = 0;
 
-    *ppinode = root_inode;
+    *ppinode = dir;
 
     return 0;
 }
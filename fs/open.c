@@ -6,6 +6,7 @@
  *   - do_close()
  *   - do_lseek()
  *   - create_file()
+ *   - do_mkdir()
  * @author Forrest Yu
  * @date   2007
  *****************************************************************************
@@ -25,10 +26,8 @@
 #include "proto.h"
 
 PRIVATE struct inode * create_file(char * path, int flags);
-PRIVATE int alloc_imap_bit(int dev);
-PRIVATE int alloc_smap_bit(int dev, int nr_sects_to_alloc);
-PRIVATE struct inode * new_inode(int dev, int inode_nr, int start_sect);
-PRIVATE void new_dir_entry(struct inode * dir_inode, int inode_nr, char * filename);
+PRIVATE struct inode * new_inode(int dev, int inode_nr, int mode);
+PRIVATE void free_new_inode(struct inode * pin);
 
 /*****************************************************************************
  *                                do_open
@@ -80,7 +79,7 @@ PUBLIC int do_open()
 		if (flags & O_CREAT) {
 			pin = create_file(pathname, flags);
     #ifdef ENABLE_DISK_LOG
-	syslog("PROCESS: created file '%s' by pid:%d\n", pathname, src);	
+	logev(LOG_CREATE, src, 1, log_str(pathname));
 	#endif	
 		}
 		else {
@@ -98,11 +97,13 @@ PUBLIC int do_open()
 		       (flags == (O_RDWR | O_TRUNC          )) ||
 		       (flags == (O_RDWR | O_TRUNC | O_CREAT)));
 
-		char filename[MAX_PATH];
-		struct inode * dir_inode;
-		if (strip_path(filename, pathname, &dir_inode) != 0)
+		pin = get_inode(root_inode->i_dev, inode_nr);
+		if ((pin->i_mode & I_TYPE_MASK) == I_DIRECTORY &&
+		    (flags & O_TRUNC)) {
+			printl("{FS} cannot truncate directory: %s\n", pathname);
+			put_inode(pin);
 			return -1;
-		pin = get_inode(dir_inode->i_dev, inode_nr);
+		}
 	}
 	else { /* file exists, no O_RDWR flag */
 		printl("{FS} file exists: %s\n", pathname);
@@ -125,6 +126,9 @@ PUBLIC int do_open()
 		f_desc_table[i].fd_mode = flags;
 		f_desc_table[i].fd_cnt = 1;
 		f_desc_table[i].fd_pos = 0;
+		f_desc_table[i].fd_ra_pos = 0;
+		f_desc_table[i].fd_ra_win = 0;
+		f_desc_table[i].fd_ra_end = 0;
 
 		int imode = pin->i_mode & I_TYPE_MASK;
 
@@ -140,7 +144,7 @@ PUBLIC int do_open()
 				  &driver_msg);
 		}
 		else if (imode == I_DIRECTORY) {
-			assert(pin->i_num == ROOT_INODE);
+			/* a directory can be read like a file */
 		}
 		else {
 			assert(pin->i_mode == I_REGULAR);
@@ -152,7 +156,7 @@ PUBLIC int do_open()
 #ifdef ENABLE_DISK_LOG
     // 只记录非创建的打开
     if (!(inode_nr == INVALID_INODE && (flags & O_CREAT))) {
-        syslog("PROCESS: opened file '%s' by pid:%d\n", pathname, src);	
+        logev(LOG_OPEN, src, 1, log_str(pathname));
     }
 #endif
 	return fd;
@@ -179,17 +183,70 @@ PRIVATE struct inode * create_file(char * path, int flags)
 	if (strip_path(filename, path, &dir_inode) != 0)
 		return 0;
 
-	int inode_nr = alloc_imap_bit(dir_inode->i_dev);
-	int free_sect_nr = alloc_smap_bit(dir_inode->i_dev,
-					  NR_DEFAULT_FILE_SECTS);
-	struct inode *newino = new_inode(dir_inode->i_dev, inode_nr,
-					 free_sect_nr);
+	struct inode *newino = 0;
+	if (filename[0]) {
+		int inode_nr = alloc_imap_bit(dir_inode->i_dev);
+		newino = new_inode(dir_inode->i_dev, inode_nr, I_REGULAR);
 
-	new_dir_entry(dir_inode, newino->i_num, filename);
+		if (dir_add(dir_inode, filename, newino->i_num) != 0) {
+			printl("{FS} directory is full: %s\n", path);
+			free_new_inode(newino);
+			newino = 0;
+		}
+	}
 
+	put_inode(dir_inode);
 	return newino;
 }
 
+/*****************************************************************************
+ *                                do_mkdir
+ *****************************************************************************/
+/**
+ * Create a directory.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int do_mkdir()
+{
+	char pathname[MAX_PATH];
+
+	/* get parameters from the message */
+	int name_len = fs_msg.NAME_LEN;	/* length of filename */
+	int src = fs_msg.source;	/* caller proc nr. */
+	assert(name_len < MAX_PATH);
+	phys_copy((void*)va2la(TASK_FS, pathname),
+		  (void*)va2la(src, fs_msg.PATHNAME),
+		  name_len);
+	pathname[name_len] = 0;
+
+	char filename[MAX_PATH];
+	struct inode * dir_inode;
+	if (strip_path(filename, pathname, &dir_inode) != 0)
+		return -1;
+
+	if (filename[0] == 0 || dir_lookup(dir_inode, filename)) {
+		printl("{FS} cannot create directory: %s\n", pathname);
+		put_inode(dir_inode);
+		return -1;
+	}
+
+	int inode_nr = alloc_imap_bit(dir_inode->i_dev);
+	struct inode * pin = new_inode(dir_inode->i_dev, inode_nr, I_DIRECTORY);
+
+	if (init_dir(pin, dir_inode->i_num) != 0 ||
+	    dir_add(dir_inode, filename, pin->i_num) != 0) {
+		printl("{FS} no room for directory: %s\n", pathname);
+		free_new_inode(pin);
+		put_inode(dir_inode);
+		return -1;
+	}
+
+	put_inode(pin);
+	put_inode(dir_inode);
+	return 0;
+}
+
 /*****************************************************************************
  *                                do_close
  *****************************************************************************/
@@ -248,94 +305,6 @@ PUBLIC int do_lseek()
 	return pos;
 }
 
-/*****************************************************************************
- *                                alloc_imap_bit
- *****************************************************************************/
-/**
- * Allocate a bit in inode-map.
- * 
- * @param dev  In which device the inode-map is located.
- * 
- * @return  I-node nr.
- *****************************************************************************/
-PRIVATE int alloc_imap_bit(int dev)
-{
-	int inode_nr = 0;
-	int i, j, k;
-
-	int imap_blk0_nr = 1 + 1; /* 1 boot sector & 1 super block */
-	struct super_block * sb = get_super_block(dev);
-
-	for (i = 0; i < sb->nr_imap_sects; i++) {
-		RD_SECT(dev, imap_blk0_nr + i);
-
-		for (j = 0; j < SECTOR_SIZE; j++) {
-			/* skip `11111111' bytes */
-			if (fsbuf[j] == 0xFF)
-				continue;
-			/* skip `1' bits */
-			for (k = 0; ((fsbuf[j] >> k) & 1) != 0; k++) {}
-			/* i: sector index; j: byte index; k: bit index */
-			inode_nr = (i * SECTOR_SIZE + j) * 8 + k;
-			fsbuf[j] |= (1 << k);
-			/* write the bit to imap */
-			WR_SECT(dev, imap_blk0_nr + i);
-			break;
-		}
-
-		return inode_nr;
-	}
-
-	/* no free bit in imap */
-	panic("inode-map is probably full.\n");
-
-	return 0;
-}
-
-/*****************************************************************************
- *                                alloc_smap_bit
- *****************************************************************************/
-/**
- * Allocate a bit in sector-map.
- * 
- * @param dev  In which device the sector-map is located.
- * @param nr_sects_to_alloc  How many sectors are allocated.
- * 
- * @return  The 1st sector nr allocated.
- *****************************************************************************/
-PRIVATE int alloc_smap_bit(int dev, int nr_sects_to_alloc)
-{
-	/* int nr_sects_to_alloc = NR_DEFAULT_FILE_SECTS; */
-
-
-	int i, j, k;
-	struct super_block * sb = get_super_block(dev);
-	int smap_blk0_nr = 1 + 1 + sb->nr_imap_sects;
-	int free_sect_nr = 0;
-	int found_first = 0;
-
-	for (i = 0; i < sb->nr_smap_sects && nr_sects_to_alloc > 0; i++) {
-		RD_SECT(dev, smap_blk0_nr + i);
-		for (j = 0; j < SECTOR_SIZE && nr_sects_to_alloc > 0; j++) {
-			for (k = 0; k < 8 && nr_sects_to_alloc > 0; k++) {
-				if (((fsbuf[j] >> k) & 1) == 0) {
-					fsbuf[j] |= (1 << k);
-					int cur_sect_nr = (i * SECTOR_SIZE + j) * 8 + k + sb->n_1st_sect;
-					if (!found_first) {
-						free_sect_nr = cur_sect_nr;
-						found_first = 1;
-					}
-					nr_sects_to_alloc--;
-				}
-			}
-		}
-		WR_SECT(dev, smap_blk0_nr + i);
-	}
-
-	assert(nr_sects_to_alloc == 0);
-	return free_sect_nr;
-}
-
 /*****************************************************************************
  *                                new_inode
  *****************************************************************************/
@@ -344,18 +313,22 @@ PRIVATE int alloc_smap_bit(int dev, int nr_sects_to_alloc)
  * 
  * @param dev  Home device of the i-node.
  * @param inode_nr  I-node nr.
- * @param start_sect  Start sector of the file pointed by the new i-node.
+ * @param mode  I_REGULAR or I_DIRECTORY.
  * 
- * @return  Ptr of the new i-node.
+ * @return  Ptr of the new i-node. No sector is allocated until the file
+ *          is written.
  *****************************************************************************/
-PRIVATE struct inode * new_inode(int dev, int inode_nr, int start_sect)
+PRIVATE struct inode * new_inode(int dev, int inode_nr, int mode)
 {
 	struct inode * new_inode = get_inode(dev, inode_nr);
 
-	new_inode->i_mode = I_REGULAR;
+	new_inode->i_mode = mode;
 	new_inode->i_size = 0;
-	new_inode->i_start_sect = start_sect;
-	new_inode->i_nr_sects = NR_DEFAULT_FILE_SECTS;
+	new_inode->i_start_sect = 0;
+	new_inode->i_nr_sects = 0;
+	memset(new_inode->i_ext, 0, sizeof(new_inode->i_ext));
+	new_inode->i_ext_sect = 0;
+	new_inode->i_nr_exts = 0;
 
 	new_inode->i_dev = dev;
 	new_inode->i_cnt = 1;
@@ -368,60 +341,24 @@ PRIVATE struct inode * new_inode(int dev, int inode_nr, int start_sect)
 }
 
 /*****************************************************************************
- *                                new_dir_entry
+ *                                free_new_inode
  *****************************************************************************/
 /**
- * Write a new entry into the directory.
+ * Undo new_inode() and alloc_imap_bit() when the file cannot be created
+ * after all.
  * 
- * @param dir_inode  I-node of the directory.
- * @param inode_nr   I-node nr of the new file.
- * @param filename   Filename of the new file.
+ * @param pin  Ptr of the new i-node.
  *****************************************************************************/
-PRIVATE void new_dir_entry(struct inode *dir_inode,int inode_nr,char *filename)
+PRIVATE void free_new_inode(struct inode * pin)
 {
-	/* write the dir_entry */
-	int dir_blk0_nr = dir_inode->i_start_sect;
-	int nr_dir_blks = (dir_inode->i_size + SECTOR_SIZE) / SECTOR_SIZE;
-	int nr_dir_entries =
-		dir_inode->i_size / DIR_ENTRY_SIZE; /**
-						     * including unused slots
-						     * (the file has been
-						     * deleted but the slot
-						     * is still there)
-						     */
-	int m = 0;
-	struct dir_entry * pde;
-	struct dir_entry * new_de = 0;
-
-	int i, j;
-	for (i = 0; i < nr_dir_blks; i++) {
-		RD_SECT(dir_inode->i_dev, dir_blk0_nr + i);
-
-		pde = (struct dir_entry *)fsbuf;
-		for (j = 0; j < SECTOR_SIZE / DIR_ENTRY_SIZE; j++,pde++) {
-			if (++m > nr_dir_entries)
-				break;
-
-			if (pde->inode_nr == 0) { /* it's a free slot */
-				new_de = pde;
-				break;
-			}
-		}
-		if (m > nr_dir_entries ||/* all entries have been iterated or */
-		    new_de)              /* free slot is found */
-			break;
-	}
-	if (!new_de) { /* reached the end of the dir */
-		new_de = pde;
-		dir_inode->i_size += DIR_ENTRY_SIZE;
-	}
-	new_de->inode_nr = inode_nr;
-	strcpy(new_de->name, filename);
+	int dev = pin->i_dev;
+	int inode_nr = pin->i_num;
 
-	/* write dir block -- ROOT dir block */
-	WR_SECT(dir_inode->i_dev, dir_blk0_nr + i);
+	free_extents(pin);
+	pin->i_mode = 0;
+	pin->i_size = 0;
+	sync_inode(pin);
+	put_inode(pin);
 
-	/* update dir inode */
-	sync_inode(dir_inode);
+	free_imap_bit(dev, inode_nr);
 }
-
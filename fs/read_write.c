@@ -25,14 +25,22 @@
 #include "keyboard.h"
 #include "proto.h"
 
+PRIVATE void read_partial_sect(struct inode* pin, int blk, u8* dst);
+PRIVATE void readahead(struct file_desc* pfd, int pos, int blk_min,
+                       int blk_max);
+
 /*****************************************************************************
  *                                do_rdwt
  *****************************************************************************/
 /**
  * Read/Write file and return byte count read/written.
  *
- * Sector map is not needed to update, since the sectors for the file have been
- * allocated and the bits are set when the file was created.
+ * Sectors are allocated by extend_file() before a write which goes beyond
+ * them. Only when the device is full will a write be cut short.
+ *
+ * A large read has the driver put the whole sectors right into the caller's
+ * buffer; only the partial sectors at its ends are copied from the buffer
+ * cache.
  *
  * @return How many bytes have been read/written.
  *****************************************************************************/
@@ -87,52 +95,155 @@ PUBLIC int do_rdwt() {
             // 读操作日志
 #ifdef ENABLE_DISK_LOG
             if (pin->i_mode == I_REGULAR) {
-                syslog("  W_R_proc: read file (inode:%d) by pid:%d\n", pin->i_num, src);
+                logev(LOG_READ, src, 1, pin->i_num);
             }
 #endif	
         } else { /* WRITE */
-            pos_end = min(pos + len, pin->i_nr_sects * SECTOR_SIZE);
-            bytes_left = len;
+            int nr_sects = extend_file(
+                pin, (pos + len + SECTOR_SIZE - 1) >> SECTOR_SIZE_SHIFT);
+            pos_end = min(pos + len, nr_sects * SECTOR_SIZE);
+            bytes_left = pos_end - pos;
             // 写操作日志
 #ifdef ENABLE_DISK_LOG
             if (pin->i_mode == I_REGULAR) {
-                char* fname = pin->i_num == ROOT_INODE ? "/" : "unknown";
-                // 尝试获取文件名（可选，需遍历目录，简单起见此处只标记unknown）
-                syslog("  W_R_proc: wrote file (inode:%d) by pid:%d\n", pin->i_num, src);
+                logev(LOG_WRITE, src, 1, pin->i_num);
             }
 #endif	
         }
 
+        /* sector indices in the file, mapped to the device by bmap() */
         int off = pos % SECTOR_SIZE;
-        int rw_sect_min = pin->i_start_sect + (pos >> SECTOR_SIZE_SHIFT);
-        int rw_sect_max = pin->i_start_sect + (pos_end >> SECTOR_SIZE_SHIFT);
-
-        int chunk =
-            min(rw_sect_max - rw_sect_min + 1, FSBUF_SIZE >> SECTOR_SIZE_SHIFT);
+        int rw_blk_min = pos >> SECTOR_SIZE_SHIFT;
+        int rw_blk_max = pos_end >> SECTOR_SIZE_SHIFT;
 
         int bytes_rw = 0;
         int i;
-        for (i = rw_sect_min; i <= rw_sect_max; i += chunk) {
-            /* read/write this amount of bytes every time */
-            int bytes = min(bytes_left, chunk * SECTOR_SIZE - off);
-            rw_sector(DEV_READ, pin->i_dev, i * SECTOR_SIZE,
-                      chunk * SECTOR_SIZE, TASK_FS, fsbuf);
 
-            if (fs_msg.type == READ) {
+        if (fs_msg.type == READ &&
+            rw_blk_max - rw_blk_min + 1 <= RA_MAX_SECTS) {
+            /**
+             * Small read: go through the buffer cache, in which the
+             * sectors are likely there already if the file is read
+             * sequentially.
+             */
+            readahead(pcaller->filp[fd], pos, rw_blk_min, rw_blk_max);
+
+            for (i = rw_blk_min; i <= rw_blk_max && bytes_left > 0; i++) {
+                int bytes = min(bytes_left, SECTOR_SIZE - off);
+                struct buf* bp = bread(pin->i_dev, bmap(pin, i, 0));
                 phys_copy((void*)va2la(src, buf + bytes_rw),
-                          (void*)va2la(TASK_FS, fsbuf + off), bytes);
-            } else { /* WRITE */
-                phys_copy((void*)va2la(TASK_FS, fsbuf + off),
+                          (void*)va2la(TASK_FS, bp->b_data + off), bytes);
+                brelse(bp);
+
+                off = 0;
+                bytes_rw += bytes;
+                pcaller->filp[fd]->fd_pos += bytes;
+                bytes_left -= bytes;
+            }
+        } else if (fs_msg.type == WRITE &&
+                   rw_blk_max - rw_blk_min + 1 <= NR_BUF_WRITE) {
+            /**
+             * Small write: modify the sectors in the buffer cache, they
+             * will be written back later. Sectors beyond the end of the
+             * file hold nothing yet and need not be read.
+             */
+            for (i = rw_blk_min; i <= rw_blk_max && bytes_left > 0; i++) {
+                int bytes = min(bytes_left, SECTOR_SIZE - off);
+                int sect_nr = bmap(pin, i, 0);
+                struct buf* bp;
+                if ((off == 0 && bytes == SECTOR_SIZE) ||
+                    i * SECTOR_SIZE >= pin->i_size) {
+                    bp = getblk(pin->i_dev, sect_nr);
+                    if (!(bp->b_flags & B_VALID))
+                        memset(bp->b_data, 0, SECTOR_SIZE);
+                } else {
+                    bp = bread(pin->i_dev, sect_nr);
+                }
+                phys_copy((void*)va2la(TASK_FS, bp->b_data + off),
                           (void*)va2la(src, buf + bytes_rw), bytes);
-                rw_sector(DEV_WRITE, pin->i_dev, i * SECTOR_SIZE,
-                          chunk * SECTOR_SIZE, TASK_FS, fsbuf);
+                bdwrite(bp);
+                brelse(bp);
+
+                off = 0;
+                bytes_rw += bytes;
+                pcaller->filp[fd]->fd_pos += bytes;
+                bytes_left -= bytes;
+            }
+        } else {
+            int chunk;
+            for (i = rw_blk_min; i <= rw_blk_max && bytes_left > 0;
+                 i += chunk) {
+                /* r/w at most one extent or one fsbuf every time */
+                int sect_nr = bmap(pin, i, &chunk);
+                assert(sect_nr);
+                chunk = min(chunk, rw_blk_max - i + 1);
+                chunk = min(chunk, FSBUF_SIZE >> SECTOR_SIZE_SHIFT);
+                int bytes = min(bytes_left, chunk * SECTOR_SIZE - off);
+
+                /* DMA needs an even address, PIO takes any */
+                int direct =
+                    ((u32)va2la(src, buf + bytes_rw) & 1) == 0;
+
+                if (fs_msg.type == READ && direct && off == 0 &&
+                    bytes >= SECTOR_SIZE) {
+                    /**
+                     * Whole sectors go from the disk right into the
+                     * caller. The disk must hold what is dirty in the
+                     * cache.
+                     */
+                    chunk = bytes >> SECTOR_SIZE_SHIFT;
+                    bytes = chunk * SECTOR_SIZE;
+                    bflush(pin->i_dev, sect_nr, chunk);
+                    rw_sector(DEV_READ, pin->i_dev, (u64)sect_nr * SECTOR_SIZE,
+                              bytes, src, buf + bytes_rw);
+                } else if (fs_msg.type == READ && direct) {
+                    /* a partial sector at either end, via the cache */
+                    chunk = 1;
+                    bytes = min(bytes_left, SECTOR_SIZE - off);
+                    struct buf* bp = bread(pin->i_dev, sect_nr);
+                    phys_copy((void*)va2la(src, buf + bytes_rw),
+                              (void*)va2la(TASK_FS, bp->b_data + off), bytes);
+                    brelse(bp);
+                } else if (fs_msg.type == READ) {
+                    /* the disk must hold what is dirty in the cache */
+                    bflush(pin->i_dev, sect_nr, chunk);
+                    rw_sector(DEV_READ, pin->i_dev, (u64)sect_nr * SECTOR_SIZE,
+                              chunk * SECTOR_SIZE, TASK_FS, fsbuf);
+                    phys_copy((void*)va2la(src, buf + bytes_rw),
+                              (void*)va2la(TASK_FS, fsbuf + off), bytes);
+                } else { /* WRITE */
+                    int nr_sects =
+                        (off + bytes + SECTOR_SIZE - 1) >> SECTOR_SIZE_SHIFT;
+                    int tail = (off + bytes) % SECTOR_SIZE;
+
+                    /**
+                     * Only the sectors partially covered by the write need
+                     * to be read. An aligned write reads nothing at all.
+                     */
+                    if (off)
+                        read_partial_sect(pin, i, fsbuf);
+                    if (tail && (nr_sects > 1 || !off))
+                        read_partial_sect(pin, i + nr_sects - 1,
+                                          fsbuf + (nr_sects - 1) * SECTOR_SIZE);
+
+                    phys_copy((void*)va2la(TASK_FS, fsbuf + off),
+                              (void*)va2la(src, buf + bytes_rw), bytes);
+                    rw_sector(DEV_WRITE, pin->i_dev,
+                              (u64)sect_nr * SECTOR_SIZE,
+                              nr_sects * SECTOR_SIZE, TASK_FS, fsbuf);
+                    /* the sectors bypassed the buffer cache */
+                    binval(pin->i_dev, sect_nr, nr_sects);
+                }
+                off = 0;
+                bytes_rw += bytes;
+                pcaller->filp[fd]->fd_pos += bytes;
+                bytes_left -= bytes;
             }
-            off = 0;
-            bytes_rw += bytes;
-            pcaller->filp[fd]->fd_pos += bytes;
-            bytes_left -= bytes;
         }
 
+        /* a read starting here next time is a sequential one */
+        pcaller->filp[fd]->fd_ra_pos = pcaller->filp[fd]->fd_pos;
+
         if (pcaller->filp[fd]->fd_pos > pin->i_size) {
             /* update inode::size */
             pin->i_size = pcaller->filp[fd]->fd_pos;
@@ -143,3 +254,80 @@ PUBLIC int do_rdwt() {
         return bytes_rw;
     }
 }
+
+/*****************************************************************************
+ *                                read_partial_sect
+ *****************************************************************************/
+/**
+ * Get the current content of a sector which is going to be partially
+ * overwritten. The sector is read through the buffer cache, so a dirty
+ * cached copy is taken as well. A sector beyond the end of the file holds
+ * nothing yet and is not read at all.
+ *
+ * @param pin  I-node of the file.
+ * @param blk  Sector index in the file.
+ * @param dst  Where to put the SECTOR_SIZE bytes.
+ *****************************************************************************/
+PRIVATE void read_partial_sect(struct inode* pin, int blk, u8* dst) {
+    if (blk * SECTOR_SIZE >= pin->i_size) {
+        memset(dst, 0, SECTOR_SIZE);
+        return;
+    }
+
+    struct buf* bp = bread(pin->i_dev, bmap(pin, blk, 0));
+    memcpy(dst, bp->b_data, SECTOR_SIZE);
+    brelse(bp);
+}
+
+/*****************************************************************************
+ *                                readahead
+ *****************************************************************************/
+/**
+ * Read ahead for a sequentially read file.
+ *
+ * A read is sequential if it starts where the last one on the same file
+ * descriptor ended. For sequential reads the window starts at RA_MIN_SECTS
+ * and doubles every time the reads catch up with what has been read ahead,
+ * up to RA_MAX_SECTS. A non-sequential read closes the window.
+ *
+ * Only the sectors of the current read are waited for, by the bread()s
+ * that follow. The ones ahead are read while the caller goes on.
+ *
+ * @param pfd      The file descriptor.
+ * @param pos      Where the read starts (in bytes).
+ * @param blk_min  The 1st sector of the read (index in the file).
+ * @param blk_max  The last sector of the read (index in the file).
+ *****************************************************************************/
+PRIVATE void readahead(struct file_desc* pfd, int pos, int blk_min,
+                       int blk_max) {
+    struct inode* pin = pfd->fd_inode;
+
+    if (pos != pfd->fd_ra_pos) {
+        pfd->fd_ra_win = 0;
+        pfd->fd_ra_end = 0;
+        return;
+    }
+
+    if (blk_max < pfd->fd_ra_end || pin->i_size == 0)
+        return;
+
+    pfd->fd_ra_win = pfd->fd_ra_win ? min(pfd->fd_ra_win * 2, RA_MAX_SECTS)
+                                    : RA_MIN_SECTS;
+
+    /* the sectors of the current read are fetched along */
+    int last = (pin->i_size - 1) / SECTOR_SIZE;
+    int start = max(blk_min, pfd->fd_ra_end);
+    int end = min(blk_max + pfd->fd_ra_win, last);
+
+    /* one extent at a time */
+    while (start <= end) {
+        int run;
+        int sect_nr = bmap(pin, start, &run);
+        assert(sect_nr);
+        run = min(run, end - start + 1);
+        bprefetch(pin->i_dev, sect_nr, run);
+        start += run;
+    }
+
+    pfd->fd_ra_end = end + 1;
+}
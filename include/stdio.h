@@ -50,6 +50,71 @@ struct stat {
 	int st_size;		/* file size */
 };
 
+/**
+ * @struct dirent
+ * @brief  A directory entry and the status of its file, returned by syscall
+ *         readdir().
+ */
+struct dirent {
+	char		d_name[16];	/* filename, 0-terminated */
+	struct stat	d_stat;		/* status of the file */
+};
+
+/**
+ * @def   IO_RING_ENTS
+ * @brief How many entries the submission and completion queues of an
+ *        io_ring have. It must be a power of 2.
+ */
+#define	IO_RING_ENTS	16
+
+/**
+ * @def   IO_FD_PREV
+ * @brief Used as io_sqe::fd, it means the fd returned by the latest OPEN
+ *        of the ring.
+ */
+#define	IO_FD_PREV	(-2)
+
+/**
+ * @struct io_sqe
+ * @brief  A request queued in an io_ring.
+ */
+struct io_sqe {
+	int	opcode;		/* OPEN, CLOSE, READ, WRITE, LSEEK, STAT or UNLINK */
+	int	fd;		/* file descriptor, or IO_FD_PREV */
+	void *	buf;		/* r/w buffer, or pathname */
+	int	len;		/* r/w bytes, or length of pathname */
+	int	flags;		/* OPEN: flags; LSEEK: whence */
+	int	off;		/* LSEEK: offset */
+	void *	addr;		/* STAT: struct stat to fill */
+	int	user_data;	/* copied to io_cqe::user_data */
+};
+
+/**
+ * @struct io_cqe
+ * @brief  The result of a request, what the syscall would have returned.
+ */
+struct io_cqe {
+	int	user_data;
+	int	res;
+};
+
+/**
+ * @struct io_ring
+ * @brief  Queues of FS requests, submitted to FS in batches by io_enter().
+ *
+ * The indices run freely and wrap around IO_RING_ENTS. The process owns
+ * sq_tail and cq_head, FS owns sq_head, cq_tail and last_fd.
+ */
+struct io_ring {
+	u32		sq_head;	/* next request FS will take */
+	u32		sq_tail;	/* next free request slot */
+	u32		cq_head;	/* next result to be reaped */
+	u32		cq_tail;	/* next free result slot */
+	int		last_fd;	/* what IO_FD_PREV stands for */
+	struct io_sqe	sq[IO_RING_ENTS];
+	struct io_cqe	cq[IO_RING_ENTS];
+};
+
 /**
  * @struct time
  * @brief  RTC time from CMOS.
@@ -63,6 +128,112 @@ struct time {
 	u32 second;
 };
 
+/**
+ * @struct kinfo
+ * @brief  What the kernel publishes to all procs.
+ *
+ * Every proc has it mapped read-only by the segment in its `fs', so it can
+ * be read without IPC (see get_ticks() and get_time()).
+ */
+struct kinfo {
+	int		ticks;		/* a copy of `ticks' */
+	u32		rtc_seq;	/* odd while rtc is being updated */
+	struct time	rtc;		/* RTC time, refreshed every second */
+};
+
+/* offset of a member in struct kinfo, i.e. in the segment */
+#define	KINFO_OFFSET(m)		((int)&((struct kinfo*)0)->m)
+
+/**
+ * @struct proc_stat_hdr
+ * @brief  What get_proc_stat() puts at the head of the buffer.
+ *
+ * It is followed by `nr' entries of `ent_size' bytes each. New fields are
+ * only appended to struct proc_stat (and `version' bumped), so an entry
+ * must be stepped over by `ent_size', not by sizeof(struct proc_stat).
+ */
+struct proc_stat_hdr {
+	u32	version;	/* PROC_STAT_VERSION */
+	u32	ent_size;	/* sizeof(struct proc_stat) */
+	u32	nr;		/* nr of entries following */
+	u32	now;		/* ticks when the stats were taken */
+};
+
+#define	PROC_STAT_VERSION	2
+
+/**
+ * @struct proc_stat
+ * @brief  Stats of a proc. Times are in ticks.
+ */
+struct proc_stat {
+	int	pid;
+	char	name[16];
+	int	flags;		/* p_flags */
+	int	parent;
+	int	priority;
+	int	ticks;		/* ticks left in this round */
+	u32	run_ticks;	/* how long it has been running */
+	u32	nr_vswitch;	/* how many times it blocked */
+	u32	nr_ivswitch;	/* how many times it was preempted */
+	u32	send_ticks;	/* how long it has been blocked in SENDING */
+	u32	recv_ticks;	/* how long it has been blocked in RECEIVING */
+	u32	max_wait;	/* the longest time it has waited runnable */
+	/* version 2 */
+	int	q_len;		/* how many procs are sending to it now */
+	int	q_len_max;	/* the most procs ever sending to it at a time */
+	u32	nr_queued;	/* how many senders have waited for it */
+};
+
+/**
+ * @struct ipc_trace
+ * @brief  A record of the kernel's IPC trace ring, see get_ipc_trace().
+ */
+struct ipc_trace {
+	u32	seq;		/* nr of the record since boot */
+	u32	tsc;		/* low 32 bits of the time stamp counter */
+	int	tick;
+	short	src;		/* sender, or INTERRUPT */
+	short	dst;		/* receiver */
+	short	type;		/* message type, 0 if unknown */
+	short	flags;		/* IPC_TR_* */
+};
+
+#define	IPC_TR_SEND	0x01	/* the sender hands a message over */
+#define	IPC_TR_RECV	0x02	/* the receiver takes a message over */
+#define	IPC_TR_INT	0x04	/* the message is an interrupt */
+#define	IPC_TR_BLOCKED	0x08	/* it has to wait for the other side */
+
+/**
+ * @struct log_rec
+ * @brief  A record of the disk log, see logev().
+ *
+ * It is followed by `nr_args' u32 args. A string arg is the id of a string
+ * which has been put into the log once by a LOG_STR record. The log is
+ * decoded on the host by scripts/declog, which knows what the events mean.
+ */
+struct log_rec {
+	u8	event;		/* LOG_* */
+	u8	nr_args;
+	short	pid;		/* the proc the event is about */
+	int	tick;
+};
+
+#define	LOG_VERSION	1
+#define	LOG_MAX_ARGS	4	/* for logev(), not for LOG_TEXT and LOG_STR */
+
+/* log events, args in () */
+#define	LOG_TEXT	0	/* (bytes of a syslog() line, 0-padded) */
+#define	LOG_STR		1	/* (string id, bytes of the string, 0-padded) */
+#define	LOG_TTY		2	/* (console nr) */
+#define	LOG_SYS_CHECK	3	/* () */
+#define	LOG_FORK	4	/* () pid: the child */
+#define	LOG_EXIT	5	/* () */
+#define	LOG_READ	6	/* (inode nr) */
+#define	LOG_WRITE	7	/* (inode nr) */
+#define	LOG_CREATE	8	/* (pathname) */
+#define	LOG_OPEN	9	/* (pathname) */
+#define	LOG_UNLINK	10	/* (pathname) */
+
 #define  BCD_TO_DEC(x)      ( (x >> 4) * 10 + (x & 0x0f) )
 
 /*========================*
@@ -130,6 +301,17 @@ PUBLIC	int	unlink		(const char *pathname);
 /* lib/getpid.c */
 PUBLIC int	getpid		();
 
+/* lib/gettime.c */
+PUBLIC void	get_time	(struct time * t);
+
+/* lib/msleep.c */
+PUBLIC int	msleep		(int msecs);
+
+/* lib/procstat.c */
+PUBLIC int	get_proc_stat	(void * buf, int len);
+PUBLIC int	get_ipc_trace	(struct ipc_trace * buf, int nr,
+				 u32 * cursor);
+
 /* lib/fork.c */
 PUBLIC int	fork		();
 
@@ -149,6 +331,31 @@ PUBLIC int	stat		(const char *path, struct stat *buf);
 
 /* lib/syslog.c */
 PUBLIC	int	syslog		(const char *fmt, ...);
+PUBLIC	int	logev		(int event, int pid, int nr_args, ...);
+PUBLIC	int	log_str		(const char * s);
+
+/* lib/sync.c */
+PUBLIC	int	sync		();
+
+/* lib/readdir.c */
+PUBLIC	int	readdir		(const char *path, int *cursor,
+				 struct dirent *ents, int nr);
+
+/* lib/io_ring.c */
+PUBLIC	void		io_ring_init	(struct io_ring *ring);
+PUBLIC	struct io_sqe *	io_get_sqe	(struct io_ring *ring);
+PUBLIC	int		io_enter	(struct io_ring *ring);
+PUBLIC	int		io_reap		(struct io_ring *ring,
+					 struct io_cqe *cqe);
+
+/* lib/mkdir.c */
+PUBLIC	int	mkdir		(const char *pathname);
+
+/* lib/rmdir.c */
+PUBLIC	int	rmdir		(const char *pathname);
+
+/* lib/chdir.c */
+PUBLIC	int	chdir		(const char *pathname);
 
 
 #endif /* _ORANGES_STDIO_H_ */
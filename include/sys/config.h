@@ -43,3 +43,6 @@
 #define SET_LOG_SECT_SMAP_AT_STARTUP
 #define MEMSET_LOG_SECTS
 #define NR_SECTS_FOR_LOG NR_DEFAULT_FILE_SECTS
+#define NR_LOG_BUF_SECTS 16	/* disklog() buffers up to this many sectors */
+#define LOG_FLUSH_SECTS 8	/* and writes them once this many are filled */
+#define NR_LOG_STRS 64		/* log_str() remembers this many strings */
@@ -72,6 +72,12 @@
     0x34                    /* 00-11-010-0 :                                     \
                              * Counter0 - LSB then MSB - rate generator - binary \
                              */
+#define ONE_SHOT                                                                 \
+    0x30                    /* 00-11-000-0 :                                     \
+                             * Counter0 - LSB then MSB - interrupt on terminal   \
+                             * count - binary                                    \
+                             */
+#define LATCH_COUNT 0x00    /* 00-00-000-0 : latch the count of Counter0 */
 #define TIMER_FREQ 1193182L /* clock frequency for timer in PC and AT */
 #define HZ 100              /* clock freq (software settable on IBM-PC) */
 
@@ -182,6 +188,9 @@ enum msgtype {
     GET_TICKS,
     GET_PID,
     GET_RTC_TIME,
+    SLEEP,
+    PROC_STAT,
+    IPC_TRACE,
 
     /* FS */
     OPEN,
@@ -191,7 +200,12 @@ enum msgtype {
     LSEEK,
     STAT,
     UNLINK,
-    SEARCH,
+    READDIR,
+    SYNC,
+    MKDIR,
+    RMDIR,
+    CHDIR,
+    IO_ENTER,
 
     /* FS & TTY */
     SUSPEND_PROC,
@@ -214,6 +228,9 @@ enum msgtype {
     DEV_READ,
     DEV_WRITE,
     DEV_IOCTL,
+    DEV_READ_ASYNC,
+    DEV_WRITE_ASYNC,
+    DEV_WAIT,
 
     /*ls -f*/
     PROPRINT,
@@ -238,6 +255,7 @@ enum msgtype {
 #define PID u.m3.m3i2
 #define RETVAL u.m3.m3i1
 #define STATUS u.m3.m3i1
+#define MSECS u.m3.m3i2
 
 #define DIOCTL_GET_GEO 1
 
@@ -294,8 +312,19 @@ enum msgtype {
 
 #define NR_FILES 64
 #define NR_FILE_DESC 64 /* FIXME */
-#define NR_INODE 64     /* FIXME */
+#define NR_INODE 256
+#define NR_INODE_HASH 64 /* must be a power of 2 */
+#define NR_DCACHE 128     /* names cached by fs/dcache.c */
+#define NR_DCACHE_HASH 64 /* must be a power of 2 */
 #define NR_SUPER_BLOCK 8
+#define NR_BUF 2048     /* sectors held by the FS buffer cache */
+#define NR_BUF_HASH 256 /* must be a power of 2 */
+#define NR_BUF_WRITE 16 /* writes touching at most this many sectors are
+                         * buffered in the cache */
+#define BSYNC_TICKS (3 * HZ) /* how often dirty buffers are flushed */
+#define RA_MIN_SECTS 8  /* readahead window of a newly sequential file */
+#define RA_MAX_SECTS 64 /* max readahead window, also the max sectors a read
+                         * goes through the cache, <= NR_HD_ASYNC */
 
 /* INODE::i_mode (octal, lower 12 bits reserved) */
 #define I_TYPE_MASK 0170000
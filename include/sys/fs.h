@@ -24,6 +24,40 @@ struct dev_drv_map {
  */
 #define	MAGIC_V1	0x111
 
+/**
+ * @def   MAGIC_V2
+ * @brief Magic number of FS v2.0, in which files are made of extents.
+ *
+ * A v1.0 FS is converted to v2.0 when it is mounted.
+ */
+#define	MAGIC_V2	0x112
+
+/**
+ * @def   MAGIC_V3
+ * @brief Magic number of FS v3.0, in which directories are hashed and may
+ *        be nested.
+ *
+ * A v2.0 FS is converted to v3.0 when it is mounted.
+ */
+#define	MAGIC_V3	0x113
+
+/**
+ * @def   MAX_BITMAP_SECTS
+ * @brief Max nr of sectors an inode-map or a sector-map may have.
+ */
+#define	MAX_BITMAP_SECTS	64
+
+/**
+ * @struct bitmap
+ * @brief  An inode-map or sector-map, whose sectors stay in the buffer
+ *         cache as long as the device is in use.
+ */
+struct bitmap {
+	int		nr_bits;	/**< How many bits are in use */
+	int		hint;		/**< No free bit before it */
+	struct buf *	bufs[MAX_BITMAP_SECTS];
+};
+
 /**
  * @struct super_block fs.h "include/fs.h"
  * @brief  The 2nd sector of the FS
@@ -50,6 +84,8 @@ struct super_block {
 	 * the following item(s) are only present in memory
 	 */
 	int	sb_dev; 	/**< the super block's home device */
+	struct bitmap	sb_imap;	/**< inode-map */
+	struct bitmap	sb_smap;	/**< sector-map */
 };
 
 /**
@@ -61,28 +97,69 @@ struct super_block {
  */
 #define	SUPER_BLOCK_SIZE	56
 
+/**
+ * @struct extent
+ * @brief  A run of contiguous sectors of a file.
+ */
+struct extent {
+	u32	e_start;	/**< The first sector of the run */
+	u32	e_nr;		/**< How many sectors the run has */
+};
+
+/**
+ * @def   NR_INODE_EXTS
+ * @brief How many extents follow extent 0 in the i-node.
+ */
+#define	NR_INODE_EXTS		1
+
+/**
+ * @def   NR_SECT_EXTS
+ * @brief How many extents the overflow extent sector holds.
+ */
+#define	NR_SECT_EXTS		(SECTOR_SIZE / sizeof(struct extent))
+
+/**
+ * @def   MAX_FILE_EXTS
+ * @brief Max nr of extents a file can have.
+ */
+#define	MAX_FILE_EXTS		(1 + NR_INODE_EXTS + NR_SECT_EXTS)
+
 /**
  * @struct inode
  * @brief  i-node
  *
- * The \c start_sect and\c nr_sects locate the file in the device,
- * and the size show how many bytes is used.
- * If <tt> size < (nr_sects * SECTOR_SIZE) </tt>, the rest bytes
- * are wasted and reserved for later writing.
+ * The data of a file lies in up to MAX_FILE_EXTS extents. Extent 0 is
+ * \c i_start_sect and \c i_nr_sects, where the boot loader expects the
+ * whole file to be, so `/' and kernel.bin must have only one extent
+ * (kernel.bin is moved by extend_file() when it can't grow in place).
+ * Extents 1 ~ NR_INODE_EXTS are \c i_ext[], the rest are in the overflow
+ * sector \c i_ext_sect. Sectors are allocated as the file grows, and
+ * the size shows how many bytes is used.
+ *
+ * For special files, \c i_start_sect is the device nr.\ and there is no
+ * extent at all.
  *
  * \b NOTE: Remember to change INODE_SIZE if the members are changed
  */
 struct inode {
 	u32	i_mode;		/**< Accsess mode */
 	u32	i_size;		/**< File size */
-	u32	i_start_sect;	/**< The first sector of the data */
-	u32	i_nr_sects;	/**< How many sectors the file occupies */
-	u8	_unused[16];	/**< Stuff for alignment */
+	u32	i_start_sect;	/**< The first sector of extent 0 */
+	u32	i_nr_sects;	/**< How many sectors extent 0 has */
+	struct extent i_ext[NR_INODE_EXTS]; /**< Extents 1 ~ NR_INODE_EXTS */
+	u32	i_ext_sect;	/**< The overflow extent sector, 0 if none */
+	u32	i_nr_exts;	/**< How many extents the file has */
 
 	/* the following items are only present in memory */
 	int	i_dev;
 	int	i_cnt;		/**< How many procs share this inode  */
 	int	i_num;		/**< inode nr.  */
+	struct inode *	i_hnext;	/**< next in the hash chain */
+	struct inode *	i_prev;		/**< prev in the LRU list */
+	struct inode *	i_next;		/**< next in the LRU list */
+	int	i_nr_ents;	/**< Dir: live entries, -1 if not counted yet */
+	int	i_nr_tombs;	/**< Dir: removed entries left in the buckets */
+	int	i_head_free;	/**< Dir: free entries in the head sector */
 };
 
 /**
@@ -118,6 +195,45 @@ struct dir_entry {
  */
 #define	DIR_ENTRY_SIZE	sizeof(struct dir_entry)
 
+/**
+ * @def   DIR_ENTS_PER_SECT
+ * @brief How many directory entries a sector holds.
+ */
+#define	DIR_ENTS_PER_SECT	(SECTOR_SIZE / DIR_ENTRY_SIZE)
+
+/**
+ * @def   NR_DIR_BUCKETS
+ * @brief How many hash buckets a directory has.
+ *
+ * A directory is made of a head sector followed by NR_DIR_BUCKETS bucket
+ * sectors, and its size covers all of them. A new entry goes into the head
+ * sector as long as there is room, so that the boot loader, which only
+ * looks at the beginning of `/', finds the files installed first. The
+ * other entries go into the bucket which the name hashes to, or the next
+ * bucket which has room.
+ *
+ * An entry whose inode nr is 0 is free. A free entry with an empty name
+ * has never been used, so a bucket having such an entry has never
+ * overflowed. Removed entries in buckets keep their names.
+ */
+#define	NR_DIR_BUCKETS		63
+
+/**
+ * @def   DIR_SECTS
+ * @brief How many sectors a new directory has.
+ */
+#define	DIR_SECTS		(1 + NR_DIR_BUCKETS)
+
+/**
+ * @def   MAX_DIR_SECTS
+ * @brief How many sectors a directory may grow to.
+ *
+ * A directory whose buckets are full doubles its size and rehashes the
+ * entries of its buckets. The entries are staged in the lower half of
+ * fsbuf meanwhile.
+ */
+#define	MAX_DIR_SECTS		1024
+
 /**
  * @struct file_desc
  * @brief  File Descriptor
@@ -127,25 +243,42 @@ struct file_desc {
 	int		fd_pos;		/**< Current position for R/W. */
 	int		fd_cnt;		/**< How many procs share this desc */
 	struct inode*	fd_inode;	/**< Ptr to the i-node */
+	int		fd_ra_pos;	/**< Where a sequential read goes on */
+	int		fd_ra_win;	/**< Readahead window (in sectors),
+					 *   0 if reads are not sequential */
+	int		fd_ra_end;	/**< Sectors before it are read ahead */
 };
 
 
 /**
- * Since all invocations of `rw_sector()' in FS look similar (most of the
- * params are the same), we use this macro to make code more readable.
+ * @struct buf
+ * @brief  Sector buffer of the FS buffer cache.
+ *
+ * All sectors FS reads or writes as metadata (super block, inode-map,
+ * sector-map, inodes, directories) go through one of these. A buffer is
+ * located by (b_dev, b_sect) via a hash table. Buffers nobody holds
+ * (b_cnt == 0) are linked into a LRU list so that the least recently
+ * released one is recycled first.
+ *
+ * @see fs/buffer.c
  */
-#define RD_SECT(dev,sect_nr) rw_sector(DEV_READ, \
-				       dev,				\
-				       (sect_nr) * SECTOR_SIZE,		\
-				       SECTOR_SIZE, /* read one sector */ \
-				       TASK_FS,				\
-				       fsbuf);
-#define WR_SECT(dev,sect_nr) rw_sector(DEV_WRITE, \
-				       dev,				\
-				       (sect_nr) * SECTOR_SIZE,		\
-				       SECTOR_SIZE, /* write one sector */ \
-				       TASK_FS,				\
-				       fsbuf);
+struct buf {
+	int		b_dev;		/**< Device nr., NO_DEV if unused */
+	int		b_sect;		/**< Sector nr. in the device */
+	int		b_flags;	/**< B_VALID, B_DIRTY, B_BUSY */
+	int		b_cnt;		/**< How many users hold the buffer */
+	int		b_req;		/**< Request id of the read, if B_BUSY */
+	u8*		b_data;		/**< SECTOR_SIZE bytes of data */
+	struct buf*	b_hnext;	/**< Next buffer in the hash chain */
+	struct buf*	b_prev;		/**< Prev buffer in the LRU list */
+	struct buf*	b_next;		/**< Next buffer in the LRU list */
+};
+
+/* buf::b_flags */
+#define	B_VALID		0x1	/* b_data holds the sector read from disk */
+#define	B_DIRTY		0x2	/* b_data is newer than the sector on disk */
+#define	B_BUSY		0x4	/* a read into b_data is submitted by
+				 * bprefetch() but not waited for yet */
 
 	
 #endif /* _ORANGES_FS_H_ */
@@ -12,6 +12,7 @@
 #endif
 
 EXTERN int ticks;
+EXTERN struct kinfo kinfo; /* mapped in every proc's `fs' */
 
 EXTERN int disp_pos;
 
@@ -52,6 +53,8 @@ EXTERN struct inode inode_table[NR_INODE];
 EXTERN struct super_block super_block[NR_SUPER_BLOCK];
 extern u8* fsbuf;
 extern const int FSBUF_SIZE;
+extern u8* bcache;
+extern const int BCACHE_SIZE;
 EXTERN MESSAGE fs_msg;
 EXTERN struct proc* pcaller;
 EXTERN struct inode* root_inode;
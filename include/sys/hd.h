@@ -226,6 +226,68 @@ struct part_ent {
 
 #define MAX_IO_BYTES	256	/* how many sectors does one IO can handle */
 
+/* PCI configuration space, accessed via configuration mechanism #1 */
+#define PCI_CONFIG_ADDR	0xCF8
+#define PCI_CONFIG_DATA	0xCFC
+#define PCI_REG_ID	0x00	/* device id (high 16) | vendor id (low 16) */
+#define PCI_REG_CMD	0x04	/* status (high 16) | command (low 16) */
+#define PCI_REG_CLASS	0x08	/* class | subclass | prog-if | revision */
+#define PCI_REG_HEADER	0x0C	/* bit 23: multi-function device */
+#define PCI_REG_BAR4	0x20	/* bus master IDE base address */
+#define	PCI_CMD_IO	0x1	/* I/O space enable */
+#define	PCI_CMD_MASTER	0x4	/* bus master enable */
+#define	PCI_CLASS_IDE	0x0101	/* mass storage controller / IDE */
+#define	PCI_IF_BM	0x80	/* prog-if: bus master capable */
+
+/* Bus Master IDE registers of the primary channel (offsets from BAR4) */
+#define	BM_REG_CMD	0	/* Command */
+#define	BM_REG_STATUS	2	/* Status */
+#define	BM_REG_PRDT	4	/* PRD Table Address */
+#define	BM_CMD_START	0x01	/* start/stop bus master */
+#define	BM_CMD_READ	0x08	/* 1: device to memory, 0: memory to device */
+#define	BM_STATUS_ACT	0x01	/* bus master IDE active */
+#define	BM_STATUS_ERR	0x02	/* error (write 1 to clear) */
+#define	BM_STATUS_INTR	0x04	/* interrupt (write 1 to clear) */
+
+/**
+ * @struct prd
+ * Physical Region Descriptor. A PRD table is a list of these, the last one
+ * is marked with PRD_EOT. A region must not cross a 64K boundary, and
+ * byte_cnt 0 means 64K.
+ */
+struct prd {
+	u32	addr;		/* physical address of the region */
+	u16	byte_cnt;
+	u16	flags;
+};
+#define	PRD_EOT		0x8000
+#define	NR_PRD		256	/* a power of 2, >= HD_MAX_SEGS * 2 + 2 */
+
+/**
+ * @struct hd_req
+ * A DEV_READ/DEV_WRITE request in the queue of TASK_HD.
+ */
+struct hd_req {
+	int		state;		/* REQ_FREE, REQ_PENDING or REQ_DONE */
+	int		type;		/* DEV_READ or DEV_WRITE */
+	int		drive;
+	u32		sect_nr;	/* the 1st sector (LBA of the drive) */
+	int		nr_sects;
+	u8 *		la;		/* linear address of the buffer */
+	int		bytes;
+	int		waiter;		/* who is waiting for the reply,
+					 * NO_TASK if nobody */
+	struct hd_req *	next;		/* next pending request by LBA */
+};
+#define	REQ_FREE	0
+#define	REQ_PENDING	1
+#define	REQ_DONE	2	/* done, but not waited by DEV_WAIT yet */
+
+#define	NR_HD_REQ	128	/* requests TASK_HD can hold */
+#define	NR_HD_ASYNC	64	/* async requests a caller may have submitted
+				 * but not waited for */
+#define	HD_MAX_SEGS	64	/* requests merged into one ATA command */
+
 struct hd_cmd {
 	u8	features;
 	u8	count;
@@ -245,6 +307,11 @@ struct part_info {
 struct hd_info
 {
 	int			open_cnt;
+	int			max_mult;	/* max sectors per DRQ block,
+						 * IDENTIFY word 47 */
+	int			mult_sects;	/* sectors per DRQ block set by
+						 * SET MULTIPLE, 0 if disabled */
+	int			dma;		/* DMA supported, IDENTIFY word 49 */
 	struct part_info	primary[NR_PRIM_PER_DRIVE];
 	struct part_info	logical[NR_SUB_PER_DRIVE];
 };
@@ -258,6 +325,11 @@ struct hd_info
 #define ATA_IDENTIFY		0xEC
 #define ATA_READ		0x20
 #define ATA_WRITE		0x30
+#define ATA_READ_MULTIPLE	0xC4
+#define ATA_WRITE_MULTIPLE	0xC5
+#define ATA_SET_MULTIPLE	0xC6
+#define ATA_READ_DMA		0xC8
+#define ATA_WRITE_DMA		0xCA
 /* for DEVICE register. */
 #define	MAKE_DEVICE_REG(lba,drv,lba_highest) (((lba) << 6) |		\
 					      ((drv) << 4) |		\
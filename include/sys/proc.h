@@ -54,6 +54,20 @@ struct proc {
     int ticks; /* remained ticks */
     int priority;
 
+    int rq_level;         /**< -1, or the runqueue level (= ticks) it is in */
+    struct proc* rq_prev; /**< prev in the runqueue of its level */
+    struct proc* rq_next; /**< next in the runqueue of its level */
+
+    /* accounting, all times in ticks, see PROC_STAT */
+    u32 run_ticks;   /**< how long it has been running */
+    u32 nr_vswitch;  /**< how many times it blocked */
+    u32 nr_ivswitch; /**< how many times it was preempted */
+    u32 send_ticks;  /**< how long it has been blocked in SENDING */
+    u32 recv_ticks;  /**< how long it has been blocked in RECEIVING */
+    u32 max_wait;    /**< the longest time it has waited runnable */
+    int since;       /**< when it got blocked, or queued if runnable */
+    int block_flags; /**< p_flags when it got blocked */
+
     /* u32 pid;                   /\* process id passed in from MM *\/ */
     char name[16]; /* name of the process */
 
@@ -79,12 +93,18 @@ struct proc {
                                 * next proc in the sending
                                 * queue (q_sending)
                                 */
+    struct proc* q_sending_tail; /**< last proc in q_sending */
+
+    int q_len;      /**< how many procs are in q_sending */
+    int q_len_max;  /**< the most procs ever in q_sending at a time */
+    u32 nr_queued;  /**< how many senders have waited in q_sending */
 
     int p_parent; /**< pid of parent process */
 
     int exit_status; /**< for parent */
 
     struct file_desc* filp[NR_FILES];
+    struct inode* cwd; /**< current directory, 0 for `/' */
 };
 
 struct task {
@@ -102,6 +122,16 @@ struct task {
 #define FIRST_PROC proc_table[0]
 #define LAST_PROC proc_table[NR_TASKS + NR_PROCS - 1]
 
+/**
+ * Runnable procs are queued by their remaining ticks, one queue per level,
+ * so a proc's priority must be less than NR_RQ_LEVELS.
+ * @see schedule()
+ */
+#define NR_RQ_LEVELS 32
+
+/* records in the IPC trace ring, must be a power of 2 */
+#define NR_IPC_TRACE 512
+
 /**
  * All forked proc will use memory above PROCS_BASE.
  *
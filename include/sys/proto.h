@@ -8,12 +8,17 @@
 /* kliba.asm */
 PUBLIC void out_byte(u16 port, u8 value);
 PUBLIC u8 in_byte(u16 port);
+PUBLIC void out_dword(u16 port, u32 value);
+PUBLIC u32 in_dword(u16 port);
 PUBLIC void disp_str(char* info);
 PUBLIC void disp_color_str(char* info, int color);
 PUBLIC void disable_irq(int irq);
 PUBLIC void enable_irq(int irq);
 PUBLIC void disable_int();
 PUBLIC void enable_int();
+PUBLIC void halt();
+PUBLIC u32 save_disable_int();
+PUBLIC void restore_int(u32 eflags);
 PUBLIC void port_read(u16 port, void* buf, int n);
 PUBLIC void port_write(u16 port, void* buf, int n);
 PUBLIC void glitter(int row, int col);
@@ -56,6 +61,10 @@ PUBLIC void spurious_irq(int irq);
 PUBLIC void clock_handler(int irq);
 PUBLIC void init_clock();
 PUBLIC void milli_delay(int milli_sec);
+PUBLIC void idle_halt();
+PUBLIC void idle_end();
+PUBLIC void add_timer(int pid, int deadline);
+PUBLIC int expire_timer();
 
 /* kernel/hd.c */
 PUBLIC void task_hd();
@@ -81,24 +90,76 @@ PUBLIC int rw_sector(int io_type,
                      int bytes,
                      int proc_nr,
                      void* buf);
+PUBLIC int rw_sector_async(int io_type,
+                           int dev,
+                           u64 pos,
+                           int bytes,
+                           int proc_nr,
+                           void* buf);
+PUBLIC void rw_sector_wait(int dev, int req_id);
 PUBLIC struct inode* get_inode(int dev, int num);
 PUBLIC void put_inode(struct inode* pinode);
 PUBLIC void sync_inode(struct inode* p);
 PUBLIC struct super_block* get_super_block(int dev);
 
+/* fs/buffer.c */
+PUBLIC void init_buffer();
+PUBLIC struct buf* getblk(int dev, int sect_nr);
+PUBLIC struct buf* bread(int dev, int sect_nr);
+PUBLIC void bwrite(struct buf* bp);
+PUBLIC void bdwrite(struct buf* bp);
+PUBLIC void brelse(struct buf* bp);
+PUBLIC void binval(int dev, int sect_nr, int nr_sects);
+PUBLIC void bflush(int dev, int sect_nr, int nr_sects);
+PUBLIC void bsync();
+PUBLIC void bprefetch(int dev, int sect_nr, int nr_sects);
+
+/* fs/dcache.c */
+PUBLIC void init_dcache();
+PUBLIC int dcache_lookup(struct inode* dir_inode, const char* name,
+                         int* inode_nr);
+PUBLIC void dcache_enter(struct inode* dir_inode, const char* name,
+                         int inode_nr);
+PUBLIC void dcache_purge(struct inode* dir_inode);
+
+/* fs/io_ring.c */
+PUBLIC int do_io_enter();
+
+/* fs/dir.c */
+PUBLIC int dir_lookup(struct inode* dir, const char* name);
+PUBLIC int dir_add(struct inode* dir, const char* name, int inode_nr);
+PUBLIC int dir_remove(struct inode* dir, const char* name);
+PUBLIC int dir_is_empty(struct inode* dir);
+PUBLIC int init_dir(struct inode* dir, int parent_nr);
+PUBLIC int clear_dir(struct inode* dir, int nr_sects);
+PUBLIC void pad_name(char* dst, const char* src);
+
+/* fs/extent.c */
+PUBLIC void init_bitmaps(int dev);
+PUBLIC int alloc_imap_bit(int dev);
+PUBLIC void free_imap_bit(int dev, int inode_nr);
+PUBLIC int bmap(struct inode* pin, int blk, int* run);
+PUBLIC int extend_file(struct inode* pin, int nr_sects);
+PUBLIC void free_extents(struct inode* pin);
+PUBLIC void set_smap_bits(int dev, int start_sect, int nr_sects, int val);
+
 /* fs/open.c */
 PUBLIC int do_open();
 PUBLIC int do_close();
 PUBLIC int do_lseek();
+PUBLIC int do_mkdir();
 
 /* fs/read_write.c */
 PUBLIC int do_rdwt();
 
 /* fs/link.c */
 PUBLIC int do_unlink();
+PUBLIC int do_rmdir();
 
 /* fs/misc.c */
 PUBLIC int do_stat();
+PUBLIC int do_chdir();
+PUBLIC int do_readdir();
 PUBLIC int strip_path(char* filename,
                       const char* pathname,
                       struct inode** ppinode);
@@ -106,7 +167,10 @@ PUBLIC int search_file(char* path);
 
 /* fs/disklog.c */
 PUBLIC int do_disklog();
+PUBLIC void init_disklog();
 PUBLIC int disklog(char* logstr); /* for debug */
+PUBLIC int disklog_write(const void* rec, int len);
+PUBLIC void disklog_flush();
 PUBLIC int dump_fd_graph(int  str);
 
 /* mm/main.c */
@@ -131,13 +195,18 @@ PUBLIC int is_current_console(CONSOLE* p_con);
 
 /* proc.c */
 PUBLIC void schedule();
+PUBLIC void init_runq();
+PUBLIC void free_proc(struct proc* p);
 PUBLIC void* va2la(int pid, void* va);
 PUBLIC int ldt_seg_linear(struct proc* p, int idx);
 PUBLIC void reset_msg(MESSAGE* p);
 PUBLIC void dump_msg(const char* title, MESSAGE* m);
 PUBLIC void dump_proc(struct proc* p);
 PUBLIC int send_recv(int function, int src_dest, MESSAGE* msg);
+PUBLIC int send_recv_short(int function, int src_dest, MESSAGE* msg);
 PUBLIC void inform_int(int task_nr);
+PUBLIC int copy_ipc_trace(int pid, struct ipc_trace* buf, int nr,
+                          u32* cursor);
 
 /* lib/misc.c */
 PUBLIC void spin(char* func_name);
@@ -147,6 +216,8 @@ PUBLIC void spin(char* func_name);
 /* 系统调用 - 系统级 */
 /* proc.c */
 PUBLIC int sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p);
+PUBLIC int sys_sendrec_short(int function, int src_dest, int _unused,
+                             struct proc* p);
 PUBLIC int sys_printx(int _unused1, int _unused2, char* s, struct proc* p_proc);
 PUBLIC int sys_check_stack(int _unused,
                            int _unused2,
@@ -158,5 +229,7 @@ PUBLIC void sys_call(); /* int_handler */
 
 /* 系统调用 - 用户级 */
 PUBLIC int sendrec(int function, int src_dest, MESSAGE* p_msg);
+PUBLIC int sendrec_short(int function, int src_dest, int* words);
+PUBLIC u32 kinfo_word(int offset);
 PUBLIC int printx(char* str);
 PUBLIC int check_stack();
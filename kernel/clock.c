@@ -11,6 +11,34 @@
 #include "global.h"
 #include "proto.h"
 
+#define TICK_COUNT     (TIMER_FREQ / HZ)     /* PIT counts per tick */
+#define MAX_IDLE_TICKS (0xFFFF / TICK_COUNT) /* the longest one-shot */
+
+/**
+ * @struct timer
+ * @brief  A proc sleeping until `deadline' (in ticks).
+ */
+struct timer {
+    int deadline;
+    int pid;
+};
+
+/**
+ * Pending timers, a min-heap on deadline. A proc can't have two timers for
+ * it is blocked while sleeping.
+ */
+PRIVATE struct timer timers[NR_TASKS + NR_PROCS];
+PRIVATE int nr_timers;
+
+/**
+ * Nonzero while the PIT is in one-shot mode (see idle_halt()): how many
+ * ticks the one-shot count covers. Zero in the periodic mode.
+ */
+PRIVATE int oneshot_ticks;
+
+PRIVATE void advance_ticks(int n);
+PRIVATE void set_periodic();
+
 /*****************************************************************************
  *                                clock_handler
  *****************************************************************************/
@@ -21,14 +49,20 @@
  * @param irq The IRQ nr, unused here.
  *****************************************************************************/
 PUBLIC void clock_handler(int irq) {
-    if (++ticks >= MAX_TICKS)
-        ticks = 0;
-
-    if (p_proc_ready->ticks)
-        p_proc_ready->ticks--;
+    if (oneshot_ticks) { /* the end of an idle period */
+        advance_ticks(oneshot_ticks);
+        oneshot_ticks = 0;
+        set_periodic();
+    } else {
+        advance_ticks(1);
+    }
 
-    if (key_pressed)
-        inform_int(TASK_TTY);
+    /* charge the running proc, not one blocked in idle_halt() */
+    if (p_proc_ready->p_flags == 0) {
+        p_proc_ready->run_ticks++;
+        if (p_proc_ready->ticks)
+            p_proc_ready->ticks--;
+    }
 
     if ((p_proc_ready - &FIRST_PROC >= 0xb) && DYNAMIC_CHECK)  // 仅对用户进程且排除INIT
     {
@@ -53,19 +87,168 @@ PUBLIC void clock_handler(int irq) {
 
 }
 
+/*****************************************************************************
+ *                                advance_ticks
+ *****************************************************************************/
+/**
+ * <Ring 0> Advance the clock by some ticks and wake up whoever is due.
+ *
+ * @param n  How many ticks have passed, more than one after an idle period.
+ *****************************************************************************/
+PRIVATE void advance_ticks(int n) {
+    int old = ticks;
+
+    ticks += n;
+    if (ticks >= MAX_TICKS)
+        ticks = 0;
+    kinfo.ticks = ticks;
+
+    if (key_pressed)
+        inform_int(TASK_TTY);
+
+    /* let FS write its dirty buffers back */
+    if (ticks / BSYNC_TICKS != old / BSYNC_TICKS)
+        inform_int(TASK_FS);
+
+    /* let SYS refresh the RTC time in kinfo, and wake up the sleepers */
+    if (ticks / HZ != old / HZ ||
+        (nr_timers && timers[0].deadline <= ticks))
+        inform_int(TASK_SYS);
+}
+
+/*****************************************************************************
+ *                                idle_halt
+ *****************************************************************************/
+/**
+ * <Ring 0> Nobody is runnable, halt until an interrupt. Called by schedule()
+ * with interrupts disabled, returns with them enabled.
+ *
+ * The clock would wake us up every tick for nothing, so the PIT is switched
+ * to one-shot mode to fire at the next timer deadline (or as late as the
+ * PIT can count to). idle_end() switches it back.
+ *****************************************************************************/
+PUBLIC void idle_halt() {
+    if (key_pressed) {
+        inform_int(TASK_TTY);
+        if (proc_table[TASK_TTY].p_flags == 0) { /* TTY has been woken up */
+            enable_int();
+            return;
+        }
+    }
+
+    if (!oneshot_ticks) {
+        int n = MAX_IDLE_TICKS;
+        if (nr_timers && timers[0].deadline - ticks < n)
+            n = max(timers[0].deadline - ticks, 1);
+
+        oneshot_ticks = n;
+        out_byte(TIMER_MODE, ONE_SHOT);
+        out_byte(TIMER0, (u8)(n * TICK_COUNT));
+        out_byte(TIMER0, (u8)((n * TICK_COUNT) >> 8));
+    }
+
+    halt();
+}
+
+/*****************************************************************************
+ *                                idle_end
+ *****************************************************************************/
+/**
+ * <Ring 0> Somebody is runnable again. If the one-shot has not fired yet,
+ * account for the whole ticks passed and get back to the periodic mode.
+ * Called with interrupts disabled.
+ *****************************************************************************/
+PUBLIC void idle_end() {
+    if (!oneshot_ticks)
+        return;
+
+    int count = oneshot_ticks * TICK_COUNT;
+
+    out_byte(TIMER_MODE, LATCH_COUNT);
+    int left = in_byte(TIMER0);
+    left |= in_byte(TIMER0) << 8;
+    if (left > count) /* it has counted down through 0 */
+        left = 0;
+
+    int n = (count - left) / TICK_COUNT;
+    oneshot_ticks = 0;
+    set_periodic();
+    if (n)
+        advance_ticks(n);
+}
+
+/*****************************************************************************
+ *                                add_timer
+ *****************************************************************************/
+/**
+ * <Ring 1> Have TASK_SYS woken up (by HARD_INT) at a certain tick for a
+ * proc. See expire_timer().
+ *
+ * @param pid       The proc to wake up.
+ * @param deadline  When, in ticks.
+ *****************************************************************************/
+PUBLIC void add_timer(int pid, int deadline) {
+    disable_int(); /* clock_handler() reads the heap */
+
+    assert(nr_timers < NR_TASKS + NR_PROCS);
+    int i = nr_timers++;
+    while (i > 0 && timers[(i - 1) / 2].deadline > deadline) {
+        timers[i] = timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    timers[i].deadline = deadline;
+    timers[i].pid = pid;
+
+    enable_int();
+}
+
+/*****************************************************************************
+ *                                expire_timer
+ *****************************************************************************/
+/**
+ * <Ring 1> Remove the earliest timer if it is due.
+ *
+ * @return The proc of the timer, or NO_TASK if no timer is due.
+ *****************************************************************************/
+PUBLIC int expire_timer() {
+    int pid = NO_TASK;
+
+    disable_int();
+
+    if (nr_timers && timers[0].deadline <= ticks) {
+        pid = timers[0].pid;
+
+        /* sift the last one down from the root */
+        struct timer last = timers[--nr_timers];
+        int i = 0;
+        while (2 * i + 1 < nr_timers) {
+            int c = 2 * i + 1;
+            if (c + 1 < nr_timers &&
+                timers[c + 1].deadline < timers[c].deadline)
+                c++;
+            if (last.deadline <= timers[c].deadline)
+                break;
+            timers[i] = timers[c];
+            i = c;
+        }
+        timers[i] = last;
+    }
+
+    enable_int();
+    return pid;
+}
+
 /*****************************************************************************
  *                                milli_delay
  *****************************************************************************/
 /**
- * <Ring 1~3> Delay for a specified amount of time.
+ * <Ring 1~3> Delay for a specified amount of time. The caller sleeps
+ * instead of polling the clock, so it must not be TASK_SYS.
  *
  * @param milli_sec How many milliseconds to delay.
  *****************************************************************************/
 PUBLIC void milli_delay(int milli_sec) {
-    int t = get_ticks();
-
-    while (((get_ticks() - t) * 1000 / HZ) < milli_sec) {
-    }
+    msleep(milli_sec);
 }
 
 /*****************************************************************************
@@ -77,10 +260,21 @@ PUBLIC void milli_delay(int milli_sec) {
  *****************************************************************************/
 PUBLIC void init_clock() {
     /* 初始化 8253 PIT */
-    out_byte(TIMER_MODE, RATE_GENERATOR);
-    out_byte(TIMER0, (u8)(TIMER_FREQ / HZ));
-    out_byte(TIMER0, (u8)((TIMER_FREQ / HZ) >> 8));
+    set_periodic();
 
     put_irq_handler(CLOCK_IRQ, clock_handler); /* 设定时钟中断处理程序 */
     enable_irq(CLOCK_IRQ); /* 让8259A可以接收时钟中断 */
 }
+
+/*****************************************************************************
+ *                                set_periodic
+ *****************************************************************************/
+/**
+ * <Ring 0> Have the PIT interrupt HZ times a second.
+ *
+ *****************************************************************************/
+PRIVATE void set_periodic() {
+    out_byte(TIMER_MODE, RATE_GENERATOR);
+    out_byte(TIMER0, (u8)TICK_COUNT);
+    out_byte(TIMER0, (u8)(TICK_COUNT >> 8));
+}
@@ -57,7 +57,8 @@ PUBLIC CONSOLE console_table[NR_CONSOLES];
 PUBLIC irq_handler irq_table[NR_IRQ];
 
 PUBLIC system_call sys_call_table[NR_SYS_CALL] = {sys_printx, sys_sendrec,
-                                                  sys_check_stack};
+                                                  sys_check_stack,
+                                                  sys_sendrec_short};
 
 /* FS related below */
 /*****************************************************************************/
@@ -78,6 +79,12 @@ struct dev_drv_map dd_map[] = {
     {INVALID_DRIVER}  /**< 5 : Reserved for scsi disk driver */
 };
 
+/**
+ * 5MB~6MB: sector buffer cache for FS (see fs/buffer.c)
+ */
+PUBLIC u8* bcache = (u8*)0x500000;
+PUBLIC const int BCACHE_SIZE = 0x100000;
+
 /**
  * 6MB~7MB: buffer for FS
  */
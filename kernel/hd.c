@@ -25,7 +25,19 @@
 PRIVATE void	init_hd			();
 PRIVATE void	hd_open			(int device);
 PRIVATE void	hd_close		(int device);
-PRIVATE void	hd_rdwt			(MESSAGE * p);
+PRIVATE int	hd_enqueue		(MESSAGE * p, int async);
+PRIVATE int	hd_wait			(MESSAGE * p);
+PRIVATE void	hd_do_request		();
+PRIVATE void	hd_rdwt			(struct hd_req ** batch, int n);
+PRIVATE void	hd_rdwt_split		(struct hd_req * q);
+PRIVATE void	hd_pio_rdwt		(struct hd_req ** batch, int n);
+PRIVATE void	hd_dma_rdwt		(struct hd_req ** batch, int n);
+PRIVATE u32	setup_prd		(struct hd_req ** batch, int n);
+PRIVATE void	hd_set_multiple		(int drive);
+PRIVATE void	probe_bmide		();
+PRIVATE u32	pci_read_config		(int bus, int dev, int func, int reg);
+PRIVATE void	pci_write_config	(int bus, int dev, int func, int reg,
+					 u32 val);
 PRIVATE void	hd_ioctl		(MESSAGE * p);
 PRIVATE void	hd_cmd_out		(struct hd_cmd* cmd);
 PRIVATE void	get_part_table		(int drive, int sect_nr, struct part_ent * entry);
@@ -40,6 +52,19 @@ PRIVATE	u8		hd_status;
 PRIVATE	u8		hdbuf[SECTOR_SIZE * 2];
 PRIVATE	struct hd_info	hd_info[1];
 
+/* I/O base of the bus master IDE registers, 0 if there is none */
+PRIVATE	u16		bmide;
+/* room for a PRD table aligned to its size, so it won't cross 64K */
+PRIVATE	struct prd	prd_buf[NR_PRD * 2];
+PRIVATE	struct prd *	prd_table;
+
+/* DEV_READ/DEV_WRITE requests */
+PRIVATE	struct hd_req	hd_req[NR_HD_REQ];
+PRIVATE	struct hd_req *	hd_queue;	/* pending requests sorted by LBA */
+PRIVATE	int		nr_pending;	/* requests in hd_queue */
+PRIVATE	int		nr_waiters;	/* pending requests somebody waits for */
+PRIVATE	u32		head_pos;	/* where the last transfer ended */
+
 #define	DRV_OF_DEV(dev) (dev <= MAX_PRIM ? \
 			 dev / NR_PRIM_PER_DRIVE : \
 			 (dev - MINOR_hd1a) / NR_SUB_PER_DRIVE)
@@ -49,6 +74,15 @@ PRIVATE	struct hd_info	hd_info[1];
  *****************************************************************************/
 /**
  * Main loop of HD driver.
+ *
+ * DEV_READ/DEV_WRITE requests are queued rather than done at once. The
+ * queue is served only when somebody waits for a request in it, and only
+ * after all the messages already sent to TASK_HD are received. So the
+ * requests submitted in a row by DEV_READ_ASYNC/DEV_WRITE_ASYNC can be
+ * sorted and merged before any of them goes to the disk.
+ *
+ * A reply is only sent to a process waiting for it (send_recv(BOTH, ...)),
+ * so TASK_HD never blocks on sending.
  * 
  *****************************************************************************/
 PUBLIC void task_hd()
@@ -58,9 +92,15 @@ PUBLIC void task_hd()
 	init_hd();
 
 	while (1) {
+		if (nr_waiters && !proc_table[TASK_HD].q_sending) {
+			hd_do_request();
+			continue;
+		}
+
 		send_recv(RECEIVE, ANY, &msg);
 
 		int src = msg.source;
+		int deferred = 0;
 
 		switch (msg.type) {
 		case DEV_OPEN:
@@ -73,7 +113,16 @@ PUBLIC void task_hd()
 
 		case DEV_READ:
 		case DEV_WRITE:
-			hd_rdwt(&msg);
+			deferred = hd_enqueue(&msg, 0);
+			break;
+
+		case DEV_READ_ASYNC:
+		case DEV_WRITE_ASYNC:
+			deferred = hd_enqueue(&msg, 1);
+			break;
+
+		case DEV_WAIT:
+			deferred = hd_wait(&msg);
 			break;
 
 		case DEV_IOCTL:
@@ -86,7 +135,8 @@ PUBLIC void task_hd()
 			break;
 		}
 
-		send_recv(SEND, src, &msg);
+		if (!deferred)
+			send_recv(SEND, src, &msg);
 	}
 }
 
@@ -113,6 +163,16 @@ PRIVATE void init_hd()
 	for (i = 0; i < (sizeof(hd_info) / sizeof(hd_info[0])); i++)
 		memset(&hd_info[i], 0, sizeof(hd_info[0]));
 	hd_info[0].open_cnt = 0;
+
+	for (i = 0; i < NR_HD_REQ; i++)
+		hd_req[i].state = REQ_FREE;
+	hd_queue = 0;
+	nr_pending = nr_waiters = 0;
+	head_pos = 0;
+
+	prd_table = (struct prd*)(((u32)prd_buf + sizeof(struct prd) * NR_PRD - 1)
+				  & ~(sizeof(struct prd) * NR_PRD - 1));
+	probe_bmide();
 }
 
 /*****************************************************************************
@@ -133,6 +193,7 @@ PRIVATE void hd_open(int device)
 	hd_identify(drive);
 
 	if (hd_info[drive].open_cnt++ == 0) {
+		hd_set_multiple(drive);
 		partition(drive * (NR_PART_PER_DRIVE + 1), P_PRIMARY);
 		/* print_hdinfo(&hd_info[drive]); */
 	}
@@ -156,14 +217,23 @@ PRIVATE void hd_close(int device)
 
 
 /*****************************************************************************
- *                                hd_rdwt
+ *                                hd_enqueue
  *****************************************************************************/
 /**
- * <Ring 1> This routine handles DEV_READ and DEV_WRITE message.
+ * <Ring 1> This routine handles DEV_READ, DEV_WRITE, DEV_READ_ASYNC and
+ * DEV_WRITE_ASYNC messages. The request is put into the queue, which is
+ * kept sorted by LBA.
+ *
+ * A synchronous request is replied when it's done. An asynchronous one is
+ * replied at once with the request id in REQUEST, the caller gets the
+ * completion later by DEV_WAIT.
  * 
- * @param p Message ptr.
+ * @param p      Message ptr.
+ * @param async  Nonzero if the request is asynchronous.
+ *
+ * @return Zero if the message is to be replied at once.
  *****************************************************************************/
-PRIVATE void hd_rdwt(MESSAGE * p)
+PRIVATE int hd_enqueue(MESSAGE * p, int async)
 {
 	int drive = DRV_OF_DEV(p->DEVICE);
 
@@ -181,36 +251,517 @@ PRIVATE void hd_rdwt(MESSAGE * p)
 		hd_info[drive].primary[p->DEVICE].base :
 		hd_info[drive].logical[logidx].base;
 
+	struct hd_req * q = hd_req;
+	for (; q < &hd_req[NR_HD_REQ]; q++)
+		if (q->state == REQ_FREE)
+			break;
+	if (q == &hd_req[NR_HD_REQ])
+		panic("hd request queue is full");
+
+	q->state	= REQ_PENDING;
+	q->type		= (p->type == DEV_READ ||
+			   p->type == DEV_READ_ASYNC) ? DEV_READ : DEV_WRITE;
+	q->drive	= drive;
+	q->sect_nr	= sect_nr;
+	q->nr_sects	= (p->CNT + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	q->la		= (u8*)va2la(p->PROC_NR, p->BUF);
+	q->bytes	= p->CNT;
+	q->waiter	= async ? NO_TASK : p->source;
+
+	/* insert it after the requests with the same or smaller LBA */
+	struct hd_req ** pp = &hd_queue;
+	while (*pp && (*pp)->sect_nr <= sect_nr)
+		pp = &(*pp)->next;
+	q->next = *pp;
+	*pp = q;
+
+	nr_pending++;
+	if (!async) {
+		nr_waiters++;
+		return 1;
+	}
+
+	p->REQUEST = q - hd_req;
+	return 0;
+}
+
+/*****************************************************************************
+ *                                hd_wait
+ *****************************************************************************/
+/**
+ * <Ring 1> This routine handles the DEV_WAIT message, by which the caller
+ * waits for an asynchronous request to complete.
+ * 
+ * @param p  Message ptr. REQUEST is the request id.
+ *
+ * @return Zero if the message is to be replied at once.
+ *****************************************************************************/
+PRIVATE int hd_wait(MESSAGE * p)
+{
+	assert(p->REQUEST >= 0 && p->REQUEST < NR_HD_REQ);
+	struct hd_req * q = &hd_req[p->REQUEST];
+
+	assert(q->state != REQ_FREE);
+	assert(q->waiter == NO_TASK);
+
+	if (q->state == REQ_DONE) {
+		p->CNT = q->bytes;
+		q->state = REQ_FREE;
+		return 0;
+	}
+
+	q->waiter = p->source;
+	nr_waiters++;
+	return 1;
+}
+
+/*****************************************************************************
+ *                                hd_do_request
+ *****************************************************************************/
+/**
+ * <Ring 1> Pick the next requests from the queue and do them.
+ *
+ * The queue is served in C-LOOK order: the first request at or after the
+ * sector where the last transfer ended, wrapping around to the lowest LBA.
+ * The requests following it in the queue are merged into the same ATA
+ * command as long as they are of the same direction and contiguous on the
+ * disk, even if their buffers are not. A request longer than one ATA
+ * command can move is done alone, in steps of MAX_IO_BYTES sectors.
+ *****************************************************************************/
+PRIVATE void hd_do_request()
+{
+	struct hd_req * batch[HD_MAX_SEGS];
+	struct hd_req * q;
+	struct hd_req ** pp;
+
+	/* C-LOOK */
+	for (pp = &hd_queue; *pp; pp = &(*pp)->next)
+		if ((*pp)->sect_nr >= head_pos)
+			break;
+	if (!*pp)
+		pp = &hd_queue;
+	assert(*pp);
+
+	/* merge the contiguous ones */
+	int n = 0;
+	int nr_sects = 0;
+	q = *pp;
+	do {
+		batch[n++] = q;
+		nr_sects += q->nr_sects;
+		q = q->next;
+	} while (q && n < HD_MAX_SEGS &&
+		 q->type == batch[0]->type &&
+		 q->drive == batch[0]->drive &&
+		 q->sect_nr == batch[0]->sect_nr + nr_sects &&
+		 nr_sects + q->nr_sects <= MAX_IO_BYTES &&
+		 (batch[n - 1]->bytes & 0x1FF) == 0 &&
+		 (q->bytes & 0x1FF) == 0);
+	*pp = q;	/* unlink them */
+
+	if (batch[0]->nr_sects > MAX_IO_BYTES)
+		hd_rdwt_split(batch[0]);
+	else
+		hd_rdwt(batch, n);
+
+	head_pos = batch[0]->sect_nr + nr_sects;
+
+	int i;
+	for (i = 0; i < n; i++) {
+		q = batch[i];
+		q->state = REQ_DONE;
+		nr_pending--;
+		if (q->waiter != NO_TASK) {
+			MESSAGE msg;
+			msg.type = SYSCALL_RET;
+			msg.CNT = q->bytes;
+			send_recv(SEND, q->waiter, &msg);
+			q->state = REQ_FREE;
+			nr_waiters--;
+		}
+	}
+}
+
+/*****************************************************************************
+ *                                hd_rdwt
+ *****************************************************************************/
+/**
+ * <Ring 1> Do some contiguous requests with one ATA command, by DMA if the
+ * drive can, the data is whole sectors and every buffer starts at an even
+ * address (which a PRD entry needs), otherwise by PIO.
+ * 
+ * @param batch  The requests, contiguous on the disk, MAX_IO_BYTES sectors
+ *               at most in all.
+ * @param n      How many requests.
+ *****************************************************************************/
+PRIVATE void hd_rdwt(struct hd_req ** batch, int n)
+{
+	int i;
+	int even = 1;
+
+	for (i = 0; i < n; i++)
+		if ((u32)batch[i]->la & 1)
+			even = 0;
+
+	if (bmide && hd_info[batch[0]->drive].dma && even &&
+	    (batch[n - 1]->bytes & 0x1FF) == 0)
+		hd_dma_rdwt(batch, n);
+	else
+		hd_pio_rdwt(batch, n);
+}
+
+/*****************************************************************************
+ *                                hd_rdwt_split
+ *****************************************************************************/
+/**
+ * <Ring 1> Do a request longer than MAX_IO_BYTES sectors with one ATA
+ * command per MAX_IO_BYTES sectors. The request itself is left untouched,
+ * it is completed and replied as a whole by the caller.
+ * 
+ * @param q  The request.
+ *****************************************************************************/
+PRIVATE void hd_rdwt_split(struct hd_req * q)
+{
+	struct hd_req part = *q;
+	struct hd_req * batch[1] = {&part};
+	int bytes_left = q->bytes;
+
+	while (bytes_left > 0) {
+		part.bytes = min(bytes_left, MAX_IO_BYTES * SECTOR_SIZE);
+		part.nr_sects = (part.bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		hd_rdwt(batch, 1);
+
+		part.sect_nr += part.nr_sects;
+		part.la += part.bytes;
+		bytes_left -= part.bytes;
+	}
+}
+
+/*****************************************************************************
+ *                                hd_pio_rdwt
+ *****************************************************************************/
+/**
+ * <Ring 1> Do some contiguous requests with one PIO command.
+ *
+ * If the drive is in multiple mode, READ/WRITE MULTIPLE is used so that one
+ * interrupt comes for every hd_info::mult_sects sectors. The data is moved
+ * between the data port and the requesters' buffers directly, only a
+ * partial last sector goes through hdbuf.
+ * 
+ * @param batch  The requests, contiguous on the disk.
+ * @param n      How many requests.
+ *****************************************************************************/
+PRIVATE void hd_pio_rdwt(struct hd_req ** batch, int n)
+{
+	int drive = batch[0]->drive;
+	int mult = hd_info[drive].mult_sects;
+	int is_read = batch[0]->type == DEV_READ;
+	u32 sect_nr = batch[0]->sect_nr;
+	int nr_sects = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		nr_sects += batch[i]->nr_sects;
+	assert(nr_sects <= MAX_IO_BYTES);
+
 	struct hd_cmd cmd;
 	cmd.features	= 0;
-	cmd.count	= (p->CNT + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	cmd.count	= nr_sects & 0xFF; /* 0 means 256 */
 	cmd.lba_low	= sect_nr & 0xFF;
 	cmd.lba_mid	= (sect_nr >>  8) & 0xFF;
 	cmd.lba_high	= (sect_nr >> 16) & 0xFF;
 	cmd.device	= MAKE_DEVICE_REG(1, drive, (sect_nr >> 24) & 0xF);
-	cmd.command	= (p->type == DEV_READ) ? ATA_READ : ATA_WRITE;
+	if (is_read)
+		cmd.command = mult ? ATA_READ_MULTIPLE : ATA_READ;
+	else
+		cmd.command = mult ? ATA_WRITE_MULTIPLE : ATA_WRITE;
 	hd_cmd_out(&cmd);
 
-	int bytes_left = p->CNT;
-	void * la = (void*)va2la(p->PROC_NR, p->BUF);
+	int r = 0;	/* current request */
+	int off = 0;	/* offset in the buffer of the current request */
 
-	while (bytes_left) {
-		int bytes = min(SECTOR_SIZE, bytes_left);
-		if (p->type == DEV_READ) {
+	while (nr_sects) {
+		/* sectors moved per interrupt (one DRQ block) */
+		int blk = mult ? min(mult, nr_sects) : 1;
+
+		if (is_read)
 			interrupt_wait();
-			port_read(REG_DATA, hdbuf, SECTOR_SIZE);
-			phys_copy(la, (void*)va2la(TASK_HD, hdbuf), bytes);
+		else if (!waitfor(STATUS_DRQ, STATUS_DRQ, HD_TIMEOUT))
+			panic("hd writing error.");
+
+		for (i = 0; i < blk; i++) {
+			struct hd_req * q = batch[r];
+			int bytes = min(SECTOR_SIZE, q->bytes - off);
+
+			if (is_read) {
+				if (bytes == SECTOR_SIZE) {
+					port_read(REG_DATA, q->la + off,
+						  SECTOR_SIZE);
+				}
+				else {
+					port_read(REG_DATA, hdbuf, SECTOR_SIZE);
+					phys_copy(q->la + off,
+						  (void*)va2la(TASK_HD, hdbuf),
+						  bytes);
+				}
+			}
+			else {
+				if (bytes == SECTOR_SIZE) {
+					port_write(REG_DATA, q->la + off,
+						   SECTOR_SIZE);
+				}
+				else {
+					memset(hdbuf, 0, SECTOR_SIZE);
+					phys_copy((void*)va2la(TASK_HD, hdbuf),
+						  q->la + off,
+						  bytes);
+					port_write(REG_DATA, hdbuf, SECTOR_SIZE);
+				}
+			}
+
+			off += SECTOR_SIZE;
+			if (off >= q->bytes) {
+				r++;
+				off = 0;
+			}
 		}
-		else {
-			if (!waitfor(STATUS_DRQ, STATUS_DRQ, HD_TIMEOUT))
-				panic("hd writing error.");
 
-			port_write(REG_DATA, la, bytes);
+		if (!is_read)
 			interrupt_wait();
+		nr_sects -= blk;
+	}
+}
+
+/*****************************************************************************
+ *                                hd_dma_rdwt
+ *****************************************************************************/
+/**
+ * <Ring 1> Do some contiguous requests of whole sectors with one bus master
+ * DMA command. The CPU is free while the data is moving, TASK_HD just waits
+ * for the interrupt.
+ *
+ * The buffers are linear addresses, which are also the physical addresses
+ * since the memory is identity-mapped.
+ * 
+ * @param batch  The requests, contiguous on the disk.
+ * @param n      How many requests.
+ *****************************************************************************/
+PRIVATE void hd_dma_rdwt(struct hd_req ** batch, int n)
+{
+	int drive = batch[0]->drive;
+	int is_read = batch[0]->type == DEV_READ;
+	u32 sect_nr = batch[0]->sect_nr;
+	u8 bm_cmd = is_read ? BM_CMD_READ : 0;
+	int nr_sects = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		nr_sects += batch[i]->nr_sects;
+	assert(nr_sects <= MAX_IO_BYTES);
+
+	out_dword(bmide + BM_REG_PRDT, setup_prd(batch, n));
+	out_byte(bmide + BM_REG_CMD, bm_cmd);
+	/* clear the error and interrupt bits */
+	out_byte(bmide + BM_REG_STATUS,
+		 in_byte(bmide + BM_REG_STATUS) |
+		 BM_STATUS_ERR | BM_STATUS_INTR);
+
+	struct hd_cmd cmd;
+	cmd.features	= 0;
+	cmd.count	= nr_sects & 0xFF; /* 0 means 256 */
+	cmd.lba_low	= sect_nr & 0xFF;
+	cmd.lba_mid	= (sect_nr >>  8) & 0xFF;
+	cmd.lba_high	= (sect_nr >> 16) & 0xFF;
+	cmd.device	= MAKE_DEVICE_REG(1, drive, (sect_nr >> 24) & 0xF);
+	cmd.command	= is_read ? ATA_READ_DMA : ATA_WRITE_DMA;
+	hd_cmd_out(&cmd);
+
+	out_byte(bmide + BM_REG_CMD, bm_cmd | BM_CMD_START);
+	interrupt_wait();
+	out_byte(bmide + BM_REG_CMD, bm_cmd);
+
+	u8 bm_status = in_byte(bmide + BM_REG_STATUS);
+	out_byte(bmide + BM_REG_STATUS, bm_status);
+	if ((bm_status & BM_STATUS_ERR) || (hd_status & STATUS_ERR))
+		panic("hd DMA error. bm status: 0x%x, hd status: 0x%x",
+		      bm_status, hd_status);
+}
+
+/*****************************************************************************
+ *                                setup_prd
+ *****************************************************************************/
+/**
+ * <Ring 1> Fill the PRD table with the buffers of some requests. Every
+ * buffer is cut at 64K boundaries.
+ * 
+ * @param batch  The requests.
+ * @param n      How many requests.
+ * 
+ * @return Physical address of the PRD table.
+ *****************************************************************************/
+PRIVATE u32 setup_prd(struct hd_req ** batch, int n)
+{
+	int i, j = 0;
+
+	for (i = 0; i < n; i++) {
+		u32 addr = (u32)batch[i]->la;
+		int bytes = batch[i]->bytes;
+
+		assert((addr & 1) == 0);
+		while (bytes > 0) {
+			assert(j < NR_PRD);
+			int k = min(bytes, 0x10000 - (addr & 0xFFFF));
+			prd_table[j].addr	= addr;
+			prd_table[j].byte_cnt	= k & 0xFFFF; /* 0 means 64K */
+			prd_table[j].flags	= 0;
+			addr += k;
+			bytes -= k;
+			j++;
 		}
-		bytes_left -= SECTOR_SIZE;
-		la += SECTOR_SIZE;
 	}
+	prd_table[j - 1].flags = PRD_EOT;
+
+	return (u32)va2la(TASK_HD, prd_table);
+}
+
+/*****************************************************************************
+ *                                probe_bmide
+ *****************************************************************************/
+/**
+ * <Ring 1> Look for a bus master capable IDE controller on the PCI buses and
+ * enable bus mastering on it. bmide is left 0 (PIO only) if none is found.
+ *****************************************************************************/
+PRIVATE void probe_bmide()
+{
+	int bus, dev, func;
+
+	bmide = 0;
+
+	for (bus = 0; bus < 256; bus++) {
+		for (dev = 0; dev < 32; dev++) {
+			for (func = 0; func < 8; func++) {
+				u32 id = pci_read_config(bus, dev, func,
+							 PCI_REG_ID);
+				if ((id & 0xFFFF) == 0xFFFF) {
+					if (func == 0)
+						break;	/* no such device */
+					continue;
+				}
+
+				u32 class = pci_read_config(bus, dev, func,
+							    PCI_REG_CLASS);
+				if ((class >> 16) == PCI_CLASS_IDE &&
+				    (class & (PCI_IF_BM << 8))) {
+					u32 bar4 = pci_read_config(bus, dev, func,
+								   PCI_REG_BAR4);
+					if (!(bar4 & 1)) /* not an I/O BAR */
+						continue;
+
+					u32 cmd = pci_read_config(bus, dev, func,
+								  PCI_REG_CMD);
+					pci_write_config(bus, dev, func,
+							 PCI_REG_CMD,
+							 (cmd & 0xFFFF) |
+							 PCI_CMD_IO |
+							 PCI_CMD_MASTER);
+
+					bmide = bar4 & 0xFFFC;
+					printl("{HD} bus master IDE: %x:%x.%x,"
+					       " I/O base: 0x%x\n",
+					       bus, dev, func, bmide);
+					return;
+				}
+
+				/* single-function device */
+				if (func == 0 &&
+				    !(pci_read_config(bus, dev, 0,
+						      PCI_REG_HEADER) &
+				      0x800000))
+					break;
+			}
+		}
+	}
+
+	printl("{HD} no bus master IDE, use PIO\n");
+}
+
+/*****************************************************************************
+ *                                pci_read_config
+ *****************************************************************************/
+/**
+ * <Ring 1> Read a dword from the PCI configuration space.
+ * 
+ * @param bus   Bus nr.
+ * @param dev   Device nr.
+ * @param func  Function nr.
+ * @param reg   Register offset, dword aligned.
+ * 
+ * @return The dword read.
+ *****************************************************************************/
+PRIVATE u32 pci_read_config(int bus, int dev, int func, int reg)
+{
+	out_dword(PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11) |
+		  (func << 8) | (reg & 0xFC));
+	return in_dword(PCI_CONFIG_DATA);
+}
+
+/*****************************************************************************
+ *                                pci_write_config
+ *****************************************************************************/
+/**
+ * <Ring 1> Write a dword into the PCI configuration space.
+ * 
+ * @param bus   Bus nr.
+ * @param dev   Device nr.
+ * @param func  Function nr.
+ * @param reg   Register offset, dword aligned.
+ * @param val   The dword to write.
+ *****************************************************************************/
+PRIVATE void pci_write_config(int bus, int dev, int func, int reg, u32 val)
+{
+	out_dword(PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11) |
+		  (func << 8) | (reg & 0xFC));
+	out_dword(PCI_CONFIG_DATA, val);
+}
+
+/*****************************************************************************
+ *                                hd_set_multiple
+ *****************************************************************************/
+/**
+ * <Ring 1> Put the drive into multiple mode with the largest block size it
+ * supports, so that READ/WRITE MULTIPLE can be used. The mode is left
+ * disabled if the drive doesn't support it.
+ * 
+ * @param drive  Drive Nr.
+ *****************************************************************************/
+PRIVATE void hd_set_multiple(int drive)
+{
+	int n = hd_info[drive].max_mult;
+
+	/* the block size must be a power of 2 */
+	while (n & (n - 1))
+		n &= n - 1;
+
+	hd_info[drive].mult_sects = 0;
+	if (n <= 1)
+		return;
+
+	struct hd_cmd cmd;
+	cmd.features	= 0;
+	cmd.count	= n;
+	cmd.lba_low	= 0;
+	cmd.lba_mid	= 0;
+	cmd.lba_high	= 0;
+	cmd.device	= MAKE_DEVICE_REG(0, drive, 0);
+	cmd.command	= ATA_SET_MULTIPLE;
+	hd_cmd_out(&cmd);
+	interrupt_wait();
+
+	if (hd_status & STATUS_ERR)
+		return;
+
+	hd_info[drive].mult_sects = n;
+	printl("{HD} multiple mode: %d sectors per block\n", n);
 }															
 
 
@@ -395,6 +946,10 @@ PRIVATE void hd_identify(int drive)
 	hd_info[drive].primary[0].base = 0;
 	/* Total Nr of User Addressable Sectors */
 	hd_info[drive].primary[0].size = ((int)hdinfo[61] << 16) + hdinfo[60];
+	/* Max sectors per DRQ block of READ/WRITE MULTIPLE */
+	hd_info[drive].max_mult = hdinfo[47] & 0xFF;
+	/* Capabilities: DMA supported */
+	hd_info[drive].dma = (hdinfo[49] & 0x0100) != 0;
 }
 
 /*****************************************************************************
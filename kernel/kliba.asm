@@ -18,10 +18,15 @@ global	disp_str
 global	disp_color_str
 global	out_byte
 global	in_byte
+global	out_dword
+global	in_dword
 global	enable_irq
 global	disable_irq
 global	enable_int
 global	disable_int
+global	halt
+global	save_disable_int
+global	restore_int
 global	port_read
 global	port_write
 global	glitter
@@ -126,6 +131,27 @@ in_byte:
 	nop
 	ret
 
+; ========================================================================
+;		   void out_dword(u16 port, u32 value);
+; ========================================================================
+out_dword:
+	mov	edx, [esp + 4]		; port
+	mov	eax, [esp + 4 + 4]	; value
+	out	dx, eax
+	nop
+	nop
+	ret
+
+; ========================================================================
+;		   u32 in_dword(u16 port);
+; ========================================================================
+in_dword:
+	mov	edx, [esp + 4]		; port
+	in	eax, dx
+	nop
+	nop
+	ret
+
 ; ========================================================================
 ;                  void port_read(u16 port, void* buf, int n);
 ; ========================================================================
@@ -239,6 +265,36 @@ enable_int:
 	sti
 	ret
 
+; ========================================================================
+;		   u32 save_disable_int();
+; ========================================================================
+; Disable interrupts and return the old eflags, to be given to
+; restore_int(). Unlike disable_int()/enable_int(), a pair of them can be
+; used where interrupts may be either enabled or disabled.
+save_disable_int:
+	pushf
+	cli
+	pop	eax
+	ret
+
+; ========================================================================
+;		   void restore_int(u32 eflags);
+; ========================================================================
+restore_int:
+	push	dword [esp + 4]
+	popf
+	ret
+
+; ========================================================================
+;		   void halt();
+; ========================================================================
+; Enable interrupts and wait for one. No interrupt can come in between, for
+; sti takes effect after the next instruction.
+halt:
+	sti
+	hlt
+	ret
+
 ; ========================================================================
 ;                  void glitter(int row, int col);
 ; ========================================================================
@@ -88,9 +88,14 @@ PUBLIC int kernel_main() {
                       DA_32 | DA_LIMIT_4K | DA_DRW | priv << 5);
         }
 
+        init_desc(&p->ldts[INDEX_LDT_KINFO],
+                  makelinear(SELECTOR_KERNEL_DS, &kinfo),
+                  sizeof(struct kinfo) - 1, DA_32 | DA_DR | priv << 5);
+
         p->regs.cs = INDEX_LDT_C << 3 | SA_TIL | rpl;
-        p->regs.ds = p->regs.es = p->regs.fs = p->regs.ss =
+        p->regs.ds = p->regs.es = p->regs.ss =
             INDEX_LDT_RW << 3 | SA_TIL | rpl;
+        p->regs.fs = INDEX_LDT_KINFO << 3 | SA_TIL | rpl;
         p->regs.gs = (SELECTOR_KERNEL_GS & SA_RPL_MASK) | rpl;
         p->regs.eip = (u32)t->initial_eip;
         p->regs.esp = (u32)stk;
@@ -105,17 +110,24 @@ PUBLIC int kernel_main() {
         p->has_int_msg = 0;
         p->q_sending = 0;
         p->next_sending = 0;
+        p->q_sending_tail = 0;
+        p->q_len = 0;
+        p->q_len_max = 0;
+        p->nr_queued = 0;
 
         for (j = 0; j < NR_FILES; j++)
             p->filp[j] = 0;
+        p->cwd = 0;
 
         stk -= t->stacksize;
     }
 
     k_reenter = 0;
     ticks = 0;
+    memset(&kinfo, 0, sizeof(kinfo));
 
     p_proc_ready = proc_table;
+    init_runq();
 
     init_clock();
     init_keyboard();
@@ -129,12 +141,14 @@ PUBLIC int kernel_main() {
 /*****************************************************************************
  *                                get_ticks
  *****************************************************************************/
+/**
+ * <Ring 1~3> Read `ticks' from the kinfo segment, no IPC is involved. The
+ * GET_TICKS message to TASK_SYS still works for whoever needs it.
+ *
+ * @return Clock ticks since the kernel started.
+ *****************************************************************************/
 PUBLIC int get_ticks() {
-    MESSAGE msg;
-    reset_msg(&msg);
-    msg.type = GET_TICKS;
-    send_recv(BOTH, TASK_SYS, &msg);
-    return msg.RETVAL;
+    return kinfo_word(KINFO_OFFSET(ticks));
 }
 
 /**
@@ -195,6 +209,11 @@ void untar(const char* filename) {
     int i = 0;
     int bytes = 0;
 
+    struct io_ring ring;
+    struct io_sqe* sqe;
+    struct io_cqe cqe;
+    io_ring_init(&ring);
+
     while (1) {
         bytes = read(fd, buf, SECTOR_SIZE);
         assert(bytes == SECTOR_SIZE); /* size of a TAR file
@@ -216,46 +235,75 @@ void untar(const char* filename) {
             f_len = (f_len * 8) + (*p++ - '0'); /* octal */
 
         int bytes_left = f_len;
-        int fdout = open(phdr->name, O_CREAT | O_RDWR | O_TRUNC);
-        if (fdout == -1) {
-            printf("    failed to extract file: %s\n", phdr->name);
-            printf(" aborted]\n");
-            close(fd);
-            return;
-        }
-        printf("    %s\n", phdr->name);
         strcpy(temp_filename, phdr->name);
+        Check check;
+        check.checksum = 0;  //初始化check
 
-        while (bytes_left) {
+        /* open, copy and close the file in batches, one per chunk: FS
+         * reads a chunk into buf and writes it out within one io_enter()
+         */
+        int opened = 0;
+        do {
             int iobytes = min(chunk, bytes_left);
-            read(fd, buf, ((iobytes - 1) / SECTOR_SIZE + 1) * SECTOR_SIZE);
-            bytes = write(fdout, buf, iobytes);
-            assert(bytes == iobytes);
             bytes_left -= iobytes;
-        }
-        close(fdout);
-        // here calculate its checksum
-        if (STATIC_CHECK) {
-            int fd_check = open(temp_filename, O_RDWR);
-            if (fd_check == -1) {
-                printf("open file for check failed\n");  // 打开当前文件
+
+            if (!opened) {
+                sqe = io_get_sqe(&ring);
+                sqe->opcode = OPEN;
+                sqe->buf = temp_filename;
+                sqe->len = strlen(temp_filename);
+                sqe->flags = O_CREAT | O_RDWR | O_TRUNC;
+                sqe->user_data = OPEN;
             }
-            Check check;
-            check.checksum = 0;  //初始化check
-            int bytes_get = 1;
-            char byte128[128];
-            strcpy(check.name, temp_filename);
-            while (bytes_get) {  // 循环读字节, 直到结束
-                bytes_get = read(fd_check, &byte128, sizeof(byte128));
-                int i = 0;
-                for (i = 0; i < bytes_get; i++)
-                    check.checksum ^= byte128[i];  // 按字节异或
+            if (iobytes) {
+                sqe = io_get_sqe(&ring);
+                sqe->opcode = READ;
+                sqe->fd = fd;
+                sqe->buf = buf;
+                sqe->len = ((iobytes - 1) / SECTOR_SIZE + 1) * SECTOR_SIZE;
+                sqe->user_data = READ;
+
+                sqe = io_get_sqe(&ring);
+                sqe->opcode = WRITE;
+                sqe->fd = IO_FD_PREV;
+                sqe->buf = buf;
+                sqe->len = iobytes;
+                sqe->user_data = WRITE;
+            }
+            if (bytes_left == 0) {
+                sqe = io_get_sqe(&ring);
+                sqe->opcode = CLOSE;
+                sqe->fd = IO_FD_PREV;
+                sqe->user_data = CLOSE;
             }
+
+            io_enter(&ring);
+            while (io_reap(&ring, &cqe)) {
+                if (cqe.user_data == OPEN && cqe.res == -1) {
+                    printf("    failed to extract file: %s\n", temp_filename);
+                    printf(" aborted]\n");
+                    close(fd);
+                    return;
+                }
+                if (cqe.user_data == WRITE) {
+                    assert(cqe.res == iobytes);
+                }
+            }
+            if (!opened)
+                printf("    %s\n", temp_filename);
+            opened = 1;
+
+            // here calculate its checksum
+            if (STATIC_CHECK) {
+                int k;
+                for (k = 0; k < iobytes; k++)
+                    check.checksum ^= buf[k];  // 按字节异或
+            }
+        } while (bytes_left);
+
+        if (STATIC_CHECK) {
+            strcpy(check.name, temp_filename);
             write(check_file, &check, sizeof(check));  // 将结果写入
-            close(fd_check);
-            //缓存刷新bug
-                //close(check_file);
-               // check_file = open("check_file", O_RDWR);
         }
         // 关闭当前文件
     }
@@ -276,54 +324,115 @@ void untar(const char* filename) {
 }
 
 int check_valid(int sub_argc, char* sub_argv[]) {
-    int check_fd = open("check_file",
-                        O_RDWR);  // 打开存储了校验码的文件
-    if (check_fd == -1) {
-        return 0;
-    }
-    int byte_get = 1;     // 存储读取到的
-    char check_sum = 0;   // 存储checksum
-    char temp_byte[128];  // temp_checksum
-    Check check;
+    struct io_ring ring;
+    struct io_sqe* sqe;
+    struct io_cqe cqe;
+    Check checks[16];            // 一次读多条校验码
+    char temp_byte[SECTOR_SIZE * 4];
+    int check_fd = -1;           // 存储了校验码的文件
+    int this_file = -1;
+    char check_sum = 0;          // 存储checksum
     int flag = 0;
-    while (byte_get) {  // 得到文件的checksum
-        byte_get = read(check_fd, &check, sizeof(check));
-        if (strcmp(check.name, sub_argv[0]) == 0) {
-            check_sum = check.checksum;
-            flag = 1;
+    int more_checks = 1;
+    int more_bytes = 1;
+    int k;
+
+    /* the checksum file and the program are opened and read at the same
+     * time, in batches of requests to FS
+     */
+    io_ring_init(&ring);
+    sqe = io_get_sqe(&ring);
+    sqe->opcode = OPEN;
+    sqe->buf = "check_file";
+    sqe->len = strlen("check_file");
+    sqe->flags = O_RDWR;
+    sqe->user_data = 0;
+    sqe = io_get_sqe(&ring);
+    sqe->opcode = OPEN;
+    sqe->buf = sub_argv[0];
+    sqe->len = strlen(sub_argv[0]);
+    sqe->flags = O_RDWR;
+    sqe->user_data = 1;
+
+    while (1) {
+        io_enter(&ring);
+        while (io_reap(&ring, &cqe)) {
+            switch (cqe.user_data) {
+            case 0:
+                check_fd = cqe.res;
+                more_checks = (check_fd != -1);
+                break;
+            case 1:
+                this_file = cqe.res;
+                more_bytes = (this_file != -1);
+                break;
+            case 2:  // 得到文件的checksum
+                for (k = 0; k < cqe.res / (int)sizeof(Check); k++) {
+                    if (strcmp(checks[k].name, sub_argv[0]) == 0) {
+                        check_sum ^= checks[k].checksum;
+                        flag = 1;
+                        break;
+                    }
+                }
+                more_checks = !flag && cqe.res == sizeof(checks);
+                break;
+            case 3:
+                for (k = 0; k < cqe.res; k++)
+                    check_sum ^= temp_byte[k];
+                more_bytes = (cqe.res > 0);
+                break;
+            }
+        }
+
+        if (!more_checks && !more_bytes)
             break;
+
+        if (more_checks) {
+            sqe = io_get_sqe(&ring);
+            sqe->opcode = READ;
+            sqe->fd = check_fd;
+            sqe->buf = checks;
+            sqe->len = sizeof(checks);
+            sqe->user_data = 2;
+        }
+        if (more_bytes) {
+            sqe = io_get_sqe(&ring);
+            sqe->opcode = READ;
+            sqe->fd = this_file;
+            sqe->buf = temp_byte;
+            sqe->len = sizeof(temp_byte);
+            sqe->user_data = 3;
         }
     }
-    close(check_fd);
 
+    if (check_fd != -1) {
+        sqe = io_get_sqe(&ring);
+        sqe->opcode = CLOSE;
+        sqe->fd = check_fd;
+    }
+    if (this_file != -1) {
+        sqe = io_get_sqe(&ring);
+        sqe->opcode = CLOSE;
+        sqe->fd = this_file;
+    }
+    io_enter(&ring);
+
+    if (check_fd == -1) {
+        return 0;
+    }
     if (flag == 0) {  // 没有找到文件的checksum
         printf("sorry ,%s is not registered in system\n", sub_argv[0]);
         return 0;
+    }
+    if (this_file == -1) {
+        printf("open %s wrong\n", sub_argv[0]);
+    }
+    if (!check_sum) {
+        printf("check right!\n");
+        return 1;
     } else {
-        int this_file = open(sub_argv[0], O_RDWR);
-        if (this_file == -1) {
-            printf("open %s wrong\n", sub_argv[0]);
-        }
-
-        byte_get = 1;
-        while (byte_get) {
-            byte_get = read(this_file, &temp_byte, sizeof(temp_byte));
-            if (byte_get) {
-                int i;
-                for (i = 0; i < byte_get; i++) {
-                    check_sum ^= temp_byte[i];
-                }
-            }
-        }
-
-        close(this_file);
-        if (!check_sum) {
-            printf("check right!\n");
-            return 1;
-        } else {
-            printf("sorry, %s has been modified\n", sub_argv[0]);
-            return 0;
-        }
+        printf("sorry, %s has been modified\n", sub_argv[0]);
+        return 0;
     }
 }
 
@@ -19,9 +19,38 @@
 
 PRIVATE void block(struct proc* p);
 PRIVATE void unblock(struct proc* p);
+PRIVATE void rq_enqueue(struct proc* p);
+PRIVATE void rq_dequeue(struct proc* p);
+PRIVATE void rq_refill();
 PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m);
 PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m);
 PRIVATE int deadlock(int src, int dest);
+PRIVATE void copy_msg(struct proc* to, MESSAGE* to_m,
+                      struct proc* from, MESSAGE* from_m);
+PRIVATE int msg_type(struct proc* p, MESSAGE* m);
+PRIVATE void trace_ipc(int src, int dst, int type, int flags);
+
+/**
+ * `p_msg' of a proc in sendrec_short(): the message is not in memory but in
+ * the registers saved in its stack frame (see sys_sendrec_short()).
+ */
+#define SHORT_MSG ((MESSAGE*)1)
+
+/**
+ * The runqueue. rq_head[i] lists the runnable procs with i ticks left, and
+ * bit i of rq_bitmap is set iff rq_head[i] is not empty. The running proc
+ * (p_proc_ready) is not in it.
+ */
+PRIVATE struct proc* rq_head[NR_RQ_LEVELS];
+PRIVATE volatile u32 rq_bitmap; /* interrupts may change it in idle_halt() */
+
+/**
+ * The IPC trace ring. Every message passed (and every receiver or sender
+ * that has to wait) leaves a record, the oldest ones are overwritten.
+ * ipc_trace_seq is the seq of the next record. See copy_ipc_trace().
+ */
+PRIVATE struct ipc_trace ipc_trace_ring[NR_IPC_TRACE];
+PRIVATE u32 ipc_trace_seq;
 
 #define reassembly(high, high_shift, mid, mid_shift, low) \
     (((high) << (high_shift)) + ((mid) << (mid_shift)) + (low))
@@ -30,27 +59,187 @@ PRIVATE int deadlock(int src, int dest);
  *                                schedule
  *****************************************************************************/
 /**
- * <Ring 0> Choose one proc to run.
+ * <Ring 0> Choose one proc to run: the runnable proc with the most ticks
+ * left. If no runnable proc has any ticks left, every runnable proc gets
+ * its priority as its ticks.
  *
+ * The runqueue makes it O(1), without scanning the proc table. If nobody is
+ * runnable, the CPU halts until somebody is.
  *****************************************************************************/
 PUBLIC void schedule() {
-    struct proc* p;
-    int greatest_ticks = 0;
-
-    while (!greatest_ticks) {
-        for (p = &FIRST_PROC; p <= &LAST_PROC; p++) {
-            if (p->p_flags == 0) {
-                if (p->ticks > greatest_ticks) {
-                    greatest_ticks = p->ticks;
-                    p_proc_ready = p;
-                }
+    struct proc* prev = p_proc_ready;
+    struct proc* p = prev;
+
+    if (p->p_flags == 0 && p->rq_level < 0) {
+        p->since = ticks;
+        rq_enqueue(p);
+    }
+
+    while (1) {
+        if (!rq_bitmap) {
+            /* nobody to run, halt until an interrupt wakes somebody up */
+            disable_int();
+            while (!rq_bitmap) {
+                idle_halt();
+                disable_int();
             }
+            idle_end();
+            enable_int();
+        }
+
+        int level = 31 - __builtin_clz(rq_bitmap);
+        if (level == 0) {
+            rq_refill();
+            continue;
         }
 
-        if (!greatest_ticks)
-            for (p = &FIRST_PROC; p <= &LAST_PROC; p++)
-                if (p->p_flags == 0)
-                    p->ticks = p->priority;
+        p = rq_head[level];
+        rq_dequeue(p);
+
+        /**
+         * A proc leaves the runqueue when it blocks or its slot is freed
+         * (see free_proc()), drop anything else not runnable just in case.
+         */
+        if (p->p_flags == 0)
+            break;
+    }
+
+    if (p != prev) {
+        if (prev->p_flags == 0)
+            prev->nr_ivswitch++;
+        else
+            prev->nr_vswitch++;
+    }
+    if (ticks - p->since > p->max_wait)
+        p->max_wait = ticks - p->since;
+
+    p_proc_ready = p;
+}
+
+/*****************************************************************************
+ *                                init_runq
+ *****************************************************************************/
+/**
+ * <Ring 0> Put all the runnable procs but p_proc_ready into the runqueue.
+ *
+ *****************************************************************************/
+PUBLIC void init_runq() {
+    struct proc* p;
+
+    for (p = &FIRST_PROC; p <= &LAST_PROC; p++) {
+        p->rq_level = -1;
+        p->rq_prev = p->rq_next = 0;
+    }
+
+    for (p = &FIRST_PROC; p <= &LAST_PROC; p++) {
+        p->since = ticks;
+        if (p->p_flags == 0 && p != p_proc_ready)
+            rq_enqueue(p);
+    }
+}
+
+/*****************************************************************************
+ *                                rq_enqueue
+ *****************************************************************************/
+/**
+ * <Ring 0> Append a proc to the runqueue of the level of its ticks.
+ *
+ * @param p  The runnable proc, which is not in the runqueue.
+ *****************************************************************************/
+PRIVATE void rq_enqueue(struct proc* p) {
+    int level = p->ticks;
+
+    assert(p->rq_level < 0 && !p->rq_next); /* not linked yet */
+    assert(level >= 0 && level < NR_RQ_LEVELS);
+
+    u32 eflags = save_disable_int(); /* interrupts call unblock() too */
+
+    struct proc* head = rq_head[level];
+    if (head) {
+        p->rq_prev = head->rq_prev;
+        p->rq_next = head;
+        head->rq_prev->rq_next = p;
+        head->rq_prev = p;
+    } else {
+        p->rq_prev = p->rq_next = p;
+        rq_head[level] = p;
+        rq_bitmap |= 1 << level;
+    }
+    p->rq_level = level;
+
+    restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                rq_dequeue
+ *****************************************************************************/
+/**
+ * <Ring 0> Remove a proc from the runqueue.
+ *
+ * @param p  The proc, which is in the runqueue.
+ *****************************************************************************/
+PRIVATE void rq_dequeue(struct proc* p) {
+    int level = p->rq_level;
+
+    assert(level >= 0);
+
+    u32 eflags = save_disable_int();
+
+    if (p->rq_next == p) {
+        rq_head[level] = 0;
+        rq_bitmap &= ~(1 << level);
+    } else {
+        p->rq_prev->rq_next = p->rq_next;
+        p->rq_next->rq_prev = p->rq_prev;
+        if (rq_head[level] == p)
+            rq_head[level] = p->rq_next;
+    }
+    p->rq_level = -1;
+    p->rq_prev = p->rq_next = 0;
+
+    restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                free_proc
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Mark a proc slot FREE_SLOT, taking the proc out of the
+ * runqueue first. A free slot must not stay linked in the runqueue: fork()
+ * may reuse it and the proc would be linked twice.
+ *
+ * @param p  The proc, which is not p_proc_ready.
+ *****************************************************************************/
+PUBLIC void free_proc(struct proc* p) {
+    assert(p != p_proc_ready);
+
+    u32 eflags = save_disable_int();
+
+    if (p->rq_level >= 0)
+        rq_dequeue(p);
+    p->p_flags = FREE_SLOT;
+
+    restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                rq_refill
+ *****************************************************************************/
+/**
+ * <Ring 0> All the runnable procs are out of ticks, refill them. A blocked
+ * proc is refilled when it is runnable again and the level 0 gets refilled.
+ *
+ *****************************************************************************/
+PRIVATE void rq_refill() {
+    while (rq_head[0]) {
+        struct proc* p = rq_head[0];
+        rq_dequeue(p);
+        if (p->p_flags != 0) /* see schedule() */
+            continue;
+
+        assert(p->priority > 0);
+        p->ticks = p->priority;
+        rq_enqueue(p);
     }
 }
 
@@ -136,6 +325,49 @@ PUBLIC int sys_sendrec(int function, int src_dest, MESSAGE* m, struct proc* p) {
     return 0;
 }
 
+/*****************************************************************************
+ *                                sys_sendrec_short
+ *****************************************************************************/
+/**
+ * <Ring 0> The core routine of system call `sendrec_short()'.
+ *
+ * A short message is the type and the first two words of the union in
+ * MESSAGE (m3i1 and m3i2, e.g. RETVAL and PID). It is carried in the
+ * registers of the caller both ways, so neither side copies a whole
+ * MESSAGE and the caller's memory is never touched:
+ *
+ *      in:  edx = type, esi = m3i1, edi = m3i2
+ *      out: ecx = source, edx = type, esi = m3i1, edi = m3i2
+ *
+ * The other side of the IPC needn't know it, it sends and receives
+ * ordinary MESSAGEs, of which only the short part is meaningful.
+ *
+ * @param function SEND or RECEIVE
+ * @param src_dest To/From whom the message is transferred. A RECEIVE must
+ *                 name the proc, not ANY or INTERRUPT.
+ * @param _unused  The type, which is read from p->regs with the words.
+ * @param p        The caller proc.
+ *
+ * @return Zero if success.
+ *****************************************************************************/
+PUBLIC int sys_sendrec_short(int function, int src_dest, int _unused,
+                             struct proc* p) {
+    assert(k_reenter == 0); /* make sure we are not in ring0 */
+    assert(src_dest >= 0 && src_dest < NR_TASKS + NR_PROCS);
+    assert(proc2pid(p) != src_dest);
+
+    if (function == SEND)
+        return msg_send(p, src_dest, SHORT_MSG);
+    else if (function == RECEIVE)
+        return msg_receive(p, src_dest, SHORT_MSG);
+
+    panic(
+        "{sys_sendrec_short} invalid function: "
+        "%d (SEND:%d, RECEIVE:%d).",
+        function, SEND, RECEIVE);
+    return 0;
+}
+
 /*****************************************************************************
  *				  ldt_seg_linear
  *****************************************************************************/
@@ -195,7 +427,8 @@ PUBLIC void reset_msg(MESSAGE* p) {
  *****************************************************************************/
 /**
  * <Ring 0> This routine is called after `p_flags' has been set (!= 0), it
- * calls `schedule()' to choose another proc as the `proc_ready'.
+ * takes the proc off the runqueue and calls `schedule()' to choose another
+ * proc as the `proc_ready'.
  *
  * @attention This routine does not change `p_flags'. Make sure the `p_flags'
  * of the proc to be blocked has been set properly.
@@ -204,6 +437,10 @@ PUBLIC void reset_msg(MESSAGE* p) {
  *****************************************************************************/
 PRIVATE void block(struct proc* p) {
     assert(p->p_flags);
+    p->since = ticks;
+    p->block_flags = p->p_flags;
+    if (p->rq_level >= 0)
+        rq_dequeue(p);
     schedule();
 }
 
@@ -211,13 +448,23 @@ PRIVATE void block(struct proc* p) {
  *                                unblock
  *****************************************************************************/
 /**
- * <Ring 0> This is a dummy routine. It does nothing actually. When it is
- * called, the `p_flags' should have been cleared (== 0).
+ * <Ring 0> Put the proc back into the runqueue. When it is called, the
+ * `p_flags' should have been cleared (== 0).
  *
  * @param p The unblocked proc.
  *****************************************************************************/
 PRIVATE void unblock(struct proc* p) {
     assert(p->p_flags == 0);
+
+    if (p->block_flags & SENDING)
+        p->send_ticks += ticks - p->since;
+    else if (p->block_flags & RECEIVING)
+        p->recv_ticks += ticks - p->since;
+    p->block_flags = 0;
+    p->since = ticks;
+
+    if (p->rq_level < 0 && p != p_proc_ready)
+        rq_enqueue(p);
 }
 
 /*****************************************************************************
@@ -260,6 +507,163 @@ PRIVATE int deadlock(int src, int dest) {
     return 0;
 }
 
+/*****************************************************************************
+ *                                copy_msg
+ *****************************************************************************/
+/**
+ * <Ring 0> Copy a message from the sender to the receiver.
+ *
+ * If either side is in sendrec_short() (its `p_msg' is SHORT_MSG), only the
+ * short part is copied, from or to its saved registers.
+ *
+ * @param to      The receiver.
+ * @param to_m    Where the receiver wants the message.
+ * @param from    The sender.
+ * @param from_m  The message being sent.
+ *****************************************************************************/
+PRIVATE void copy_msg(struct proc* to, MESSAGE* to_m,
+                      struct proc* from, MESSAGE* from_m) {
+    if (to_m != SHORT_MSG && from_m != SHORT_MSG) {
+        phys_copy(va2la(proc2pid(to), to_m), va2la(proc2pid(from), from_m),
+                  sizeof(MESSAGE));
+        return;
+    }
+
+    int type, w1, w2;
+    if (from_m == SHORT_MSG) {
+        type = from->regs.edx;
+        w1 = from->regs.esi;
+        w2 = from->regs.edi;
+    } else {
+        MESSAGE* fla = (MESSAGE*)va2la(proc2pid(from), from_m);
+        type = fla->type;
+        w1 = fla->u.m3.m3i1;
+        w2 = fla->u.m3.m3i2;
+    }
+
+    if (to_m == SHORT_MSG) {
+        to->regs.ecx = proc2pid(from);
+        to->regs.edx = type;
+        to->regs.esi = w1;
+        to->regs.edi = w2;
+    } else {
+        MESSAGE* tla = (MESSAGE*)va2la(proc2pid(to), to_m);
+        tla->source = proc2pid(from);
+        tla->type = type;
+        tla->u.m3.m3i1 = w1;
+        tla->u.m3.m3i2 = w2;
+    }
+}
+
+/*****************************************************************************
+ *                                msg_type
+ *****************************************************************************/
+/**
+ * <Ring 0> The type of a message being sent.
+ *
+ * @param p  The sender.
+ * @param m  The message.
+ *
+ * @return The message type.
+ *****************************************************************************/
+PRIVATE int msg_type(struct proc* p, MESSAGE* m) {
+    if (m == SHORT_MSG)
+        return p->regs.edx;
+    return ((MESSAGE*)va2la(proc2pid(p), m))->type;
+}
+
+/*****************************************************************************
+ *                                trace_ipc
+ *****************************************************************************/
+/**
+ * <Ring 0> Append a record to the IPC trace ring. It is cheap enough to be
+ * always on: a few stores, with interrupts off so that an interrupt handler
+ * can't take the same slot.
+ *
+ * @param src    Sender, INTERRUPT, or for a waiting receiver what it waits
+ *               for (maybe ANY).
+ * @param dst    Receiver.
+ * @param type   Message type, 0 if unknown.
+ * @param flags  IPC_TR_*.
+ *****************************************************************************/
+PRIVATE void trace_ipc(int src, int dst, int type, int flags) {
+    u32 tsc;
+    __asm__ __volatile__("rdtsc" : "=a"(tsc) : : "edx");
+
+    u32 eflags = save_disable_int();
+
+    struct ipc_trace* t =
+        &ipc_trace_ring[ipc_trace_seq & (NR_IPC_TRACE - 1)];
+    t->seq = ipc_trace_seq++;
+    t->tsc = tsc;
+    t->tick = ticks;
+    t->src = src;
+    t->dst = dst;
+    t->type = type;
+    t->flags = flags;
+
+    restore_int(eflags);
+}
+
+/*****************************************************************************
+ *                                copy_ipc_trace
+ *****************************************************************************/
+/**
+ * <Ring 0~1> Copy the IPC trace records from a cursor on to a proc.
+ *
+ * @param pid     The proc.
+ * @param buf     Its buffer.
+ * @param nr      How many records the buffer holds.
+ * @param cursor  [in] seq of the first record wanted, [out] seq of the
+ *                next one. If the records wanted have been overwritten,
+ *                the copy starts from the oldest one in the ring, which
+ *                the caller can tell by the seq.
+ *
+ * Interrupts are only off while ipc_trace_seq is read, before and after
+ * the copy, as in a seqlock: records overwritten during the copy are
+ * dropped.
+ *
+ * @return How many records are copied.
+ *****************************************************************************/
+PUBLIC int copy_ipc_trace(int pid, struct ipc_trace* buf, int nr,
+                          u32* cursor) {
+    u32 seq = *cursor;
+    int n = 0;
+    int i;
+
+    /* the copy is done with interrupts on, see below */
+    u32 eflags = save_disable_int();
+    u32 head = ipc_trace_seq;
+    restore_int(eflags);
+
+    if (head - seq > NR_IPC_TRACE) /* lost */
+        seq = head - NR_IPC_TRACE;
+
+    for (; n < nr && seq + n != head; n++)
+        phys_copy(va2la(pid, buf + n),
+                  &ipc_trace_ring[(seq + n) & (NR_IPC_TRACE - 1)],
+                  sizeof(struct ipc_trace));
+
+    /* drop the oldest ones if they have been overwritten meanwhile */
+    eflags = save_disable_int();
+    head = ipc_trace_seq;
+    restore_int(eflags);
+
+    if (head - seq > NR_IPC_TRACE) {
+        int lost = head - seq - NR_IPC_TRACE;
+        if (lost > n)
+            lost = n;
+        for (i = lost; i < n; i++)
+            phys_copy(va2la(pid, buf + i - lost), va2la(pid, buf + i),
+                      sizeof(struct ipc_trace));
+        seq += lost;
+        n -= lost;
+    }
+
+    *cursor = seq + n;
+    return n;
+}
+
 /*****************************************************************************
  *                                msg_send
  *****************************************************************************/
@@ -268,6 +672,9 @@ PRIVATE int deadlock(int src, int dest) {
  * the message, copy the message to it and unblock dest. Otherwise the caller
  * will be blocked and appended to the dest's sending queue.
  *
+ * Only a sender which is going to be blocked can make a deadlock, so the
+ * messaging graph is checked for cycles then and only then.
+ *
  * @param current  The caller, the sender.
  * @param dest     To whom the message is sent.
  * @param m        The message.
@@ -280,18 +687,13 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m) {
 
     assert(proc2pid(sender) != dest);
 
-    /* check for deadlock here */
-    if (deadlock(proc2pid(sender), dest)) {
-        panic(">>DEADLOCK<< %s->%s", sender->name, p_dest->name);
-    }
-
     if ((p_dest->p_flags & RECEIVING) && /* dest is waiting for the msg */
         (p_dest->p_recvfrom == proc2pid(sender) || p_dest->p_recvfrom == ANY)) {
         assert(p_dest->p_msg);
         assert(m);
 
-        phys_copy(va2la(dest, p_dest->p_msg), va2la(proc2pid(sender), m),
-                  sizeof(MESSAGE));
+        trace_ipc(proc2pid(sender), dest, msg_type(sender, m), IPC_TR_SEND);
+        copy_msg(p_dest, p_dest->p_msg, sender, m);
         p_dest->p_msg = 0;
         p_dest->p_flags &= ~RECEIVING; /* dest has received the msg */
         p_dest->p_recvfrom = NO_TASK;
@@ -306,23 +708,31 @@ PRIVATE int msg_send(struct proc* current, int dest, MESSAGE* m) {
         assert(sender->p_recvfrom == NO_TASK);
         assert(sender->p_sendto == NO_TASK);
     } else { /* dest is not waiting for the msg */
+        /* check for deadlock here */
+        if (deadlock(proc2pid(sender), dest)) {
+            panic(">>DEADLOCK<< %s->%s", sender->name, p_dest->name);
+        }
+
+        trace_ipc(proc2pid(sender), dest, msg_type(sender, m),
+                  IPC_TR_SEND | IPC_TR_BLOCKED);
+
         sender->p_flags |= SENDING;
         assert(sender->p_flags == SENDING);
         sender->p_sendto = dest;
         sender->p_msg = m;
 
         /* append to the sending queue */
-        struct proc* p;
-        if (p_dest->q_sending) {
-            p = p_dest->q_sending;
-            while (p->next_sending)
-                p = p->next_sending;
-            p->next_sending = sender;
-        } else {
+        if (p_dest->q_sending)
+            p_dest->q_sending_tail->next_sending = sender;
+        else
             p_dest->q_sending = sender;
-        }
+        p_dest->q_sending_tail = sender;
         sender->next_sending = 0;
 
+        p_dest->nr_queued++;
+        if (++p_dest->q_len > p_dest->q_len_max)
+            p_dest->q_len_max = p_dest->q_len;
+
         block(sender);
 
         assert(sender->p_flags == SENDING);
@@ -375,6 +785,8 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m) {
         assert(m);
 
         phys_copy(va2la(proc2pid(p_who_wanna_recv), m), &msg, sizeof(MESSAGE));
+        trace_ipc(INTERRUPT, proc2pid(p_who_wanna_recv), HARD_INT,
+                  IPC_TR_RECV | IPC_TR_INT);
 
         p_who_wanna_recv->has_int_msg = 0;
 
@@ -464,13 +876,17 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m) {
             prev->next_sending = p_from->next_sending;
             p_from->next_sending = 0;
         }
+        if (p_from == p_who_wanna_recv->q_sending_tail) /* the last one */
+            p_who_wanna_recv->q_sending_tail = prev;
+        p_who_wanna_recv->q_len--;
 
         assert(m);
         assert(p_from->p_msg);
 
         /* copy the message */
-        phys_copy(va2la(proc2pid(p_who_wanna_recv), m),
-                  va2la(proc2pid(p_from), p_from->p_msg), sizeof(MESSAGE));
+        trace_ipc(proc2pid(p_from), proc2pid(p_who_wanna_recv),
+                  msg_type(p_from, p_from->p_msg), IPC_TR_RECV);
+        copy_msg(p_who_wanna_recv, m, p_from, p_from->p_msg);
 
         p_from->p_msg = 0;
         p_from->p_sendto = NO_TASK;
@@ -480,6 +896,8 @@ PRIVATE int msg_receive(struct proc* current, int src, MESSAGE* m) {
         /* Set p_flags so that p_who_wanna_recv will not
          * be scheduled until it is unblocked.
          */
+        trace_ipc(src, proc2pid(p_who_wanna_recv), 0,
+                  IPC_TR_RECV | IPC_TR_BLOCKED);
         p_who_wanna_recv->p_flags |= RECEIVING;
 
         p_who_wanna_recv->p_msg = m;
@@ -510,6 +928,7 @@ PUBLIC void inform_int(int task_nr) {
 
     if ((p->p_flags & RECEIVING) && /* dest is waiting for the msg */
         ((p->p_recvfrom == INTERRUPT) || (p->p_recvfrom == ANY))) {
+        trace_ipc(INTERRUPT, task_nr, HARD_INT, IPC_TR_SEND | IPC_TR_INT);
         p->p_msg->source = INTERRUPT;
         p->p_msg->type = HARD_INT;
         p->p_msg = 0;
@@ -524,6 +943,9 @@ PUBLIC void inform_int(int task_nr) {
         assert(p->p_recvfrom == NO_TASK);
         assert(p->p_sendto == NO_TASK);
     } else {
+        if (!p->has_int_msg)
+            trace_ipc(INTERRUPT, task_nr, HARD_INT,
+                      IPC_TR_SEND | IPC_TR_INT | IPC_TR_BLOCKED);
         p->has_int_msg = 1;
     }
 }
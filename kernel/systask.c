@@ -22,6 +22,9 @@
 
 PRIVATE int read_register(char reg_addr);
 PRIVATE u32 get_rtc_time(struct time *t);
+PRIVATE void update_kinfo_rtc();
+PRIVATE void wake_sleepers();
+PRIVATE int copy_proc_stat(int pid, char * buf, int len);
 
 /*****************************************************************************
  *                                task_sys
@@ -34,12 +37,35 @@ PUBLIC void task_sys()
 {
 	MESSAGE msg;
 	struct time t;
+	int rtc_sec = ticks / HZ;
+
+	update_kinfo_rtc();
 
 	while (1) {
 		send_recv(RECEIVE, ANY, &msg);
 		int src = msg.source;
 
 		switch (msg.type) {
+		case HARD_INT:	/* from the clock: a new second, or a timer */
+			wake_sleepers();
+			if (get_ticks() / HZ != rtc_sec) {
+				rtc_sec = get_ticks() / HZ;
+				update_kinfo_rtc();
+			}
+			break;
+		case SLEEP: {
+			/* no reply until the time is up */
+			int n = (msg.MSECS * HZ + 999) / 1000;
+			if (n > 0) {
+				add_timer(src, get_ticks() + n);
+			}
+			else {
+				msg.type = SYSCALL_RET;
+				msg.RETVAL = 0;
+				send_recv_short(SEND, src, &msg);
+			}
+			break;
+		}
 		case GET_TICKS:
 			msg.RETVAL = ticks;
 			send_recv(SEND, src, &msg);
@@ -49,6 +75,20 @@ PUBLIC void task_sys()
 			msg.PID = src;
 			send_recv(SEND, src, &msg);
 			break;
+		case PROC_STAT:
+			msg.type = SYSCALL_RET;
+			msg.RETVAL = copy_proc_stat(src, msg.BUF, msg.BUF_LEN);
+			send_recv(SEND, src, &msg);
+			break;
+		case IPC_TRACE: {
+			u32 cursor = msg.POSITION;
+			msg.type = SYSCALL_RET;
+			msg.RETVAL = copy_ipc_trace(src, msg.BUF, msg.CNT,
+						    &cursor);
+			msg.POSITION = cursor;
+			send_recv(SEND, src, &msg);
+			break;
+		}
 		case GET_RTC_TIME:
 			msg.type = SYSCALL_RET;
 			get_rtc_time(&t);
@@ -65,6 +105,111 @@ PUBLIC void task_sys()
 }
 
 
+/*****************************************************************************
+ *                                wake_sleepers
+ *****************************************************************************/
+/**
+ * Reply to the procs whose SLEEP is over.
+ *****************************************************************************/
+PRIVATE void wake_sleepers()
+{
+	MESSAGE msg;
+	int pid;
+
+	while ((pid = expire_timer()) != NO_TASK) {
+		/* it may have gone during its sleep */
+		if (proc_table[pid].p_flags == FREE_SLOT)
+			continue;
+
+		/**
+		 * It may not be RECEIVING yet: SLEEP is a SEND and then a
+		 * RECEIVE, and it can be preempted in between. The SEND
+		 * waits for it like any other reply.
+		 */
+		msg.type = SYSCALL_RET;
+		msg.RETVAL = 0;
+		send_recv_short(SEND, pid, &msg);
+	}
+}
+
+/*****************************************************************************
+ *                                copy_proc_stat
+ *****************************************************************************/
+/**
+ * Copy a proc_stat_hdr and the stats of all the procs in use to a proc's
+ * buffer, as many as it can hold.
+ *
+ * @param pid  The proc asking.
+ * @param buf  Its buffer.
+ * @param len  Size of the buffer.
+ *
+ * @return Bytes copied, or -1 if the buffer can't hold the header.
+ *****************************************************************************/
+PRIVATE int copy_proc_stat(int pid, char * buf, int len)
+{
+	struct proc_stat_hdr hdr;
+	struct proc_stat ps;
+	int off = sizeof(hdr);
+	int i;
+
+	if (len < (int)sizeof(hdr))
+		return -1;
+
+	hdr.version = PROC_STAT_VERSION;
+	hdr.ent_size = sizeof(ps);
+	hdr.nr = 0;
+	hdr.now = ticks;
+
+	for (i = 0; i < NR_TASKS + NR_PROCS; i++) {
+		struct proc * p = &proc_table[i];
+		if (p->p_flags == FREE_SLOT)
+			continue;
+		if (off + (int)sizeof(ps) > len)
+			break;
+
+		ps.pid		= i;
+		memcpy(ps.name, p->name, sizeof(ps.name));
+		ps.flags	= p->p_flags;
+		ps.parent	= p->p_parent;
+		ps.priority	= p->priority;
+		ps.ticks	= p->ticks;
+		ps.run_ticks	= p->run_ticks;
+		ps.nr_vswitch	= p->nr_vswitch;
+		ps.nr_ivswitch	= p->nr_ivswitch;
+		ps.send_ticks	= p->send_ticks;
+		ps.recv_ticks	= p->recv_ticks;
+		ps.max_wait	= p->max_wait;
+		ps.q_len	= p->q_len;
+		ps.q_len_max	= p->q_len_max;
+		ps.nr_queued	= p->nr_queued;
+
+		phys_copy(va2la(pid, buf + off), &ps, sizeof(ps));
+		off += sizeof(ps);
+		hdr.nr++;
+	}
+
+	phys_copy(va2la(pid, buf), &hdr, sizeof(hdr));
+	return off;
+}
+
+/*****************************************************************************
+ *                                update_kinfo_rtc
+ *****************************************************************************/
+/**
+ * Refresh the RTC time in kinfo, which procs read by get_time(). rtc_seq is
+ * odd during the update so that the readers can tell a torn copy.
+ *****************************************************************************/
+PRIVATE void update_kinfo_rtc()
+{
+	volatile struct kinfo * k = &kinfo; /* keep the stores in order */
+	struct time t;
+	get_rtc_time(&t);
+
+	k->rtc_seq++;
+	k->rtc = t;
+	k->rtc_seq++;
+}
+
 /*****************************************************************************
  *                                get_rtc_time
  *****************************************************************************/
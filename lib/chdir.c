@@ -0,0 +1,43 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   chdir.c
+ * @brief  chdir()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                chdir
+ *****************************************************************************/
+/**
+ * Change the current directory of the caller. Relative paths
+ * are looked up from there afterwards.
+ * 
+ * @param pathname  The path of the new current directory.
+ * 
+ * @return Zero if successful, otherwise -1.
+ *****************************************************************************/
+PUBLIC int chdir(const char * pathname)
+{
+	MESSAGE msg;
+	msg.type   = CHDIR;
+
+	msg.PATHNAME	= (void*)pathname;
+	msg.NAME_LEN	= strlen(pathname);
+
+	send_recv(BOTH, TASK_FS, &msg);
+
+	return msg.RETVAL;
+}
@@ -33,7 +33,7 @@ PUBLIC int getpid()
 	MESSAGE msg;
 	msg.type	= GET_PID;
 
-	send_recv(BOTH, TASK_SYS, &msg);
+	send_recv_short(BOTH, TASK_SYS, &msg);
 	assert(msg.type == SYSCALL_RET);
 
 	return msg.PID;
@@ -0,0 +1,44 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   gettime.c
+ * @brief  get_time()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                get_time
+ *****************************************************************************/
+/**
+ * Get the RTC time cached in the kinfo segment, without IPC. TASK_SYS
+ * refreshes it every second, so it may lag behind the CMOS by up to one
+ * second.
+ *
+ * @param t  The time is put here.
+ *****************************************************************************/
+PUBLIC void get_time(struct time * t)
+{
+	u32 * w = (u32*)t;
+	u32 seq;
+	int i;
+
+	do {
+		/* TASK_SYS is updating it if rtc_seq is odd */
+		while ((seq = kinfo_word(KINFO_OFFSET(rtc_seq))) & 1)
+			;
+		for (i = 0; i < sizeof(struct time) / sizeof(u32); i++)
+			w[i] = kinfo_word(KINFO_OFFSET(rtc) + i * sizeof(u32));
+	} while (kinfo_word(KINFO_OFFSET(rtc_seq)) != seq);
+}
@@ -0,0 +1,100 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   io_ring.c
+ * @brief  io_ring_init(), io_get_sqe(), io_enter(), io_reap()
+ *
+ * A process queues FS requests in an io_ring by io_get_sqe(), hands them
+ * all to FS by one io_enter(), and picks up the results by io_reap().
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                io_ring_init
+ *****************************************************************************/
+/**
+ * Make the queues of a ring empty.
+ * 
+ * @param ring  The ring.
+ *****************************************************************************/
+PUBLIC void io_ring_init(struct io_ring *ring)
+{
+	memset(ring, 0, sizeof(struct io_ring));
+	ring->last_fd = -1;
+}
+
+/*****************************************************************************
+ *                                io_get_sqe
+ *****************************************************************************/
+/**
+ * Take a free request slot. The request goes to FS at the next io_enter().
+ * 
+ * @param ring  The ring.
+ * 
+ * @return Ptr to the cleared slot, or zero if the submission queue is full.
+ *****************************************************************************/
+PUBLIC struct io_sqe * io_get_sqe(struct io_ring *ring)
+{
+	if (ring->sq_tail - ring->sq_head == IO_RING_ENTS)
+		return 0;
+
+	struct io_sqe * sqe = &ring->sq[ring->sq_tail++ & (IO_RING_ENTS - 1)];
+	memset(sqe, 0, sizeof(struct io_sqe));
+	return sqe;
+}
+
+/*****************************************************************************
+ *                                io_enter
+ *****************************************************************************/
+/**
+ * Have FS carry out the queued requests, in order. FS stops early when the
+ * completion queue is full.
+ * 
+ * @param ring  The ring.
+ * 
+ * @return How many requests FS has taken.
+ *****************************************************************************/
+PUBLIC int io_enter(struct io_ring *ring)
+{
+	MESSAGE msg;
+
+	msg.type	= IO_ENTER;
+	msg.BUF		= (void*)ring;
+
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                io_reap
+ *****************************************************************************/
+/**
+ * Take the oldest result out of the completion queue.
+ * 
+ * @param[in]  ring  The ring.
+ * @param[out] cqe   The result.
+ * 
+ * @return 1 if there is a result, otherwise 0.
+ *****************************************************************************/
+PUBLIC int io_reap(struct io_ring *ring, struct io_cqe *cqe)
+{
+	if (ring->cq_head == ring->cq_tail)
+		return 0;
+
+	*cqe = ring->cq[ring->cq_head++ & (IO_RING_ENTS - 1)];
+	return 1;
+}
@@ -61,6 +61,53 @@ PUBLIC int send_recv(int function, int src_dest, MESSAGE* msg)
 	return ret;
 }
 
+/*****************************************************************************
+ *                                send_recv_short
+ *****************************************************************************/
+/**
+ * <Ring 1~3> IPC syscall for short messages.
+ *
+ * Same as send_recv(), but only the type and the first two words of the
+ * union (m3i1 and m3i2, e.g. RETVAL and PID) are transferred, in registers
+ * (see sys_sendrec_short()). The peer must be a certain proc, it can't be
+ * ANY or INTERRUPT.
+ *
+ * @param function  SEND, RECEIVE or BOTH
+ * @param src_dest  The caller's proc_nr
+ * @param msg       Pointer to the MESSAGE struct
+ * 
+ * @return always 0.
+ *****************************************************************************/
+PUBLIC int send_recv_short(int function, int src_dest, MESSAGE* msg)
+{
+	int ret = 0;
+	int words[4] = {0, msg->type, msg->u.m3.m3i1, msg->u.m3.m3i2};
+
+	switch (function) {
+	case BOTH:
+		ret = sendrec_short(SEND, src_dest, words);
+		if (ret == 0)
+			ret = sendrec_short(RECEIVE, src_dest, words);
+		break;
+	case SEND:
+		return sendrec_short(SEND, src_dest, words);
+	case RECEIVE:
+		ret = sendrec_short(RECEIVE, src_dest, words);
+		break;
+	default:
+		assert((function == BOTH) ||
+		       (function == SEND) || (function == RECEIVE));
+		break;
+	}
+
+	msg->source	= words[0];
+	msg->type	= words[1];
+	msg->u.m3.m3i1	= words[2];
+	msg->u.m3.m3i2	= words[3];
+
+	return ret;
+}
+
 /*****************************************************************************
  *                                memcmp
  *****************************************************************************/
@@ -0,0 +1,42 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   msleep.c
+ * @brief  msleep()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                msleep
+ *****************************************************************************/
+/**
+ * Sleep for some milliseconds. The caller is blocked by TASK_SYS until the
+ * time is up, rounded up to clock ticks.
+ *
+ * @param msecs  How long to sleep.
+ *
+ * @return Zero.
+ *****************************************************************************/
+PUBLIC int msleep(int msecs)
+{
+	MESSAGE msg;
+	msg.type	= SLEEP;
+	msg.MSECS	= msecs;
+
+	send_recv_short(BOTH, TASK_SYS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
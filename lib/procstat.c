@@ -0,0 +1,74 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   procstat.c
+ * @brief  get_proc_stat(), get_ipc_trace()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                get_proc_stat
+ *****************************************************************************/
+/**
+ * Get the CPU accounting stats of all procs. The buffer is filled with a
+ * struct proc_stat_hdr followed by struct proc_stat entries.
+ *
+ * @param buf  Buffer for the stats.
+ * @param len  Size of the buffer.
+ *
+ * @return Bytes filled, or -1 if the buffer is too small for the header.
+ *****************************************************************************/
+PUBLIC int get_proc_stat(void * buf, int len)
+{
+	MESSAGE msg;
+	msg.type	= PROC_STAT;
+	msg.BUF		= buf;
+	msg.BUF_LEN	= len;
+
+	send_recv(BOTH, TASK_SYS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
+
+/*****************************************************************************
+ *                                get_ipc_trace
+ *****************************************************************************/
+/**
+ * Drain the kernel's IPC trace ring.
+ *
+ * @param buf     Buffer for the records.
+ * @param nr      How many records the buffer holds.
+ * @param cursor  [in] seq of the first record wanted (0 at first),
+ *                [out] seq of the next one, for the next call. Records
+ *                overwritten before they are drained are skipped, the seq
+ *                of the records shows the gap.
+ *
+ * @return How many records are got.
+ *****************************************************************************/
+PUBLIC int get_ipc_trace(struct ipc_trace * buf, int nr, u32 * cursor)
+{
+	MESSAGE msg;
+	msg.type	= IPC_TRACE;
+	msg.BUF		= buf;
+	msg.CNT		= nr;
+	msg.POSITION	= *cursor;
+
+	send_recv(BOTH, TASK_SYS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	*cursor = msg.POSITION;
+	return msg.RETVAL;
+}
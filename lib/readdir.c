@@ -0,0 +1,56 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   readdir.c
+ * @brief  readdir()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                readdir
+ *****************************************************************************/
+/**
+ * Read a batch of entries of a directory, along with the status of their
+ * files.
+ * 
+ * @param path    The directory.
+ * @param cursor  Where to go on: 0 at the first call, then left as this
+ *                function sets it.
+ * @param ents    Where to put the entries.
+ * @param nr      How many entries \c ents can hold.
+ * 
+ * @return How many entries are read, 0 if there is no more. On error, -1
+ *         is returned.
+ *****************************************************************************/
+PUBLIC int readdir(const char *path, int *cursor, struct dirent *ents, int nr)
+{
+	MESSAGE msg;
+
+	msg.type	= READDIR;
+
+	msg.PATHNAME	= (void*)path;
+	msg.NAME_LEN	= strlen(path);
+	msg.BUF		= (void*)ents;
+	msg.BUF_LEN	= nr * sizeof(struct dirent);
+	msg.POSITION	= *cursor;
+
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	if (msg.RETVAL > 0)
+		*cursor = (int)msg.POSITION;
+
+	return msg.RETVAL;
+}
@@ -11,6 +11,10 @@
 #include "proto.h"
 
 PUBLIC char* search_dir(char* path,char* filename) {
+    /* unknown mode, e.g. the old directory search: use readdir() */
+    if (*path != 'P' && *path != 'K')
+        return (char*)-1;
+
     if(*path == 'P')
     {
         MESSAGE msg;
@@ -29,7 +33,7 @@ PUBLIC char* search_dir(char* path,char* filename) {
         //filename[strlen(filename)] = '\0'; 
         return filename;
     }
-    else if(*path == 'K')
+    else
     {
         MESSAGE msg;
         msg.type = PRO_KILL;
@@ -45,22 +49,4 @@ PUBLIC char* search_dir(char* path,char* filename) {
         memcpy(filename, msg.pBUF, strlen(msg.pBUF));
         return (char*)0;
     }
-    else 
-    {
-        MESSAGE msg;
-        msg.type = SEARCH;
-        // msg.pBUF[0] = 'y';
-        // msg.pBUF[1] = 'j'; 
-        // msg.pBUF[2] = 'q';
-        memcpy(msg.pBUF, path, strlen(path));
-        // printl("msg.pBug address is %d\n", msg.pBUF);
-        // printl("BUF1 : %s\n", msg.pBUF);
-        send_recv(BOTH, TASK_FS, &msg);
-        // return msg.BUF;
-        // printl("BUF2 : %s\n", msg.pBUF);
-        
-        memcpy(filename, msg.pBUF, strlen(msg.pBUF));
-        //filename[strlen(filename)] = '\0'; 
-        return filename;
-    }
 }
@@ -0,0 +1,38 @@
+/*************************************************************************//**
+ *****************************************************************************
+ * @file   sync.c
+ * @brief  sync()
+ *****************************************************************************
+ *****************************************************************************/
+
+#include "type.h"
+#include "stdio.h"
+#include "const.h"
+#include "protect.h"
+#include "string.h"
+#include "fs.h"
+#include "proc.h"
+#include "tty.h"
+#include "console.h"
+#include "global.h"
+#include "proto.h"
+
+
+/*****************************************************************************
+ *                                sync
+ *****************************************************************************/
+/**
+ * Write all the data cached by FS to the disk.
+ *
+ * @return Zero if successful.
+ *****************************************************************************/
+PUBLIC int sync()
+{
+	MESSAGE msg;
+	msg.type	= SYNC;
+
+	send_recv(BOTH, TASK_FS, &msg);
+	assert(msg.type == SYSCALL_RET);
+
+	return msg.RETVAL;
+}
@@ -11,11 +11,14 @@ INT_VECTOR_SYS_CALL equ 0x90
 _NR_printx	    equ 0
 _NR_sendrec	    equ 1
 _NR_check_stack equ 2
+_NR_sendrec_short equ 3
 
 ; 导出符号
 global	printx
 global	sendrec
 global  check_stack
+global	sendrec_short
+global	kinfo_word
 
 bits 32
 [section .text]
@@ -41,6 +44,42 @@ sendrec:
 
 	ret
 
+; ====================================================================================
+;             sendrec_short(int function, int src_dest, int* words);
+; ====================================================================================
+; words[4]: source, type, m3i1, m3i2 of a short message, which goes to and
+; comes back from the kernel in registers.
+; Never call sendrec_short() directly, call send_recv_short() instead.
+sendrec_short:
+	push	ebx		; .
+	push	ecx		;  |
+	push	edx		;  > 20 bytes
+	push	esi		;  |
+	push	edi		; /
+
+	mov	eax, [esp + 20 + 12]	; words
+	mov	edx, [eax +  4]		; type
+	mov	esi, [eax +  8]		; m3i1
+	mov	edi, [eax + 12]		; m3i2
+	mov	ebx, [esp + 20 +  4]	; function
+	mov	ecx, [esp + 20 +  8]	; src_dest
+	mov	eax, _NR_sendrec_short
+	int	INT_VECTOR_SYS_CALL
+
+	mov	ebx, [esp + 20 + 12]	; words
+	mov	[ebx], ecx		; source
+	mov	[ebx +  4], edx		; type
+	mov	[ebx +  8], esi		; m3i1
+	mov	[ebx + 12], edi		; m3i2
+
+	pop	edi
+	pop	esi
+	pop	edx
+	pop	ecx
+	pop	ebx
+
+	ret
+
 ; ====================================================================================
 ;                          void printx(char* s);
 ; ====================================================================================
@@ -55,6 +94,15 @@ printx:
 
 	ret
 
+; ====================================================================================
+;                          u32 kinfo_word(int offset);
+; ====================================================================================
+; Read a dword of struct kinfo, which is mapped in fs. Not a system call.
+kinfo_word:
+	mov	eax, [esp + 4]		; offset
+	mov	eax, [fs:eax]
+	ret
+
 check_stack:
 	mov  eax, _NR_check_stack
 	int  INT_VECTOR_SYS_CALL
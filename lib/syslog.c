@@ -8,6 +8,7 @@
  *****************************************************************************/
 
 #include "type.h"
+#include "config.h"
 #include "stdio.h"
 #include "const.h"
 #include "protect.h"
@@ -19,6 +20,18 @@
 #include "global.h"
 #include "proto.h"
 
+/**
+ * Strings which have been put into the log by log_str(), so that a string
+ * is written once and then referred to by its id. It is direct-mapped by
+ * the hash of the string, a string which has been pushed out is simply put
+ * into the log again, with a new id.
+ */
+PRIVATE struct {
+	int	id;		/* 0 if free */
+	char	str[MAX_PATH];
+} log_strs[NR_LOG_STRS];
+
+PRIVATE int	last_str_id;
 
 /*****************************************************************************
  *                                syslog
@@ -45,3 +58,78 @@ PUBLIC int syslog(const char *fmt, ...)
 	return disklog(buf);
 }
 
+/*****************************************************************************
+ *                                logev
+ *****************************************************************************/
+/**
+ * Put an event into the log as a binary record, with no formatting. It is
+ * decoded by scripts/declog on the host.
+ * 
+ * @param event    LOG_*.
+ * @param pid      The proc the event is about.
+ * @param nr_args  Nr of the int args following, at most LOG_MAX_ARGS. A
+ *                 string arg is passed as log_str(s).
+ * 
+ * @return The log position after the record.
+ *****************************************************************************/
+PUBLIC int logev(int event, int pid, int nr_args, ...)
+{
+	u32 rec[(sizeof(struct log_rec) >> 2) + LOG_MAX_ARGS];
+	struct log_rec * r = (struct log_rec *)rec;
+
+	assert(nr_args <= LOG_MAX_ARGS);
+
+	r->event = event;
+	r->nr_args = nr_args;
+	r->pid = pid;
+	r->tick = get_ticks();
+	memcpy(r + 1, (char*)(&nr_args) + 4, nr_args * 4); /* the args */
+
+	return disklog_write(rec, sizeof(*r) + nr_args * 4);
+}
+
+/*****************************************************************************
+ *                                log_str
+ *****************************************************************************/
+/**
+ * Get the id of a string for a string arg of logev(). The string is put
+ * into the log by a LOG_STR record unless it has been there.
+ * 
+ * @param s  The string, longer ones are cut to MAX_PATH - 1 chars.
+ * 
+ * @return The id.
+ *****************************************************************************/
+PUBLIC int log_str(const char * s)
+{
+	u32 h = 0;
+	int len;
+
+	for (len = 0; len < MAX_PATH - 1 && s[len]; len++)
+		h = h * 31 + (u8)s[len];
+
+	int i = h & (NR_LOG_STRS - 1);
+	if (log_strs[i].id &&
+	    memcmp(log_strs[i].str, (void*)s, len) == 0 &&
+	    log_strs[i].str[len] == 0)
+		return log_strs[i].id;
+
+	log_strs[i].id = ++last_str_id;
+	memcpy(log_strs[i].str, (void*)s, len);
+	log_strs[i].str[len] = 0;
+
+	/* LOG_STR: the id, then the string padded to a multiple of 4 */
+	u32 rec[(sizeof(struct log_rec) >> 2) + 1 + (MAX_PATH >> 2)];
+	struct log_rec * r = (struct log_rec *)rec;
+	int nr_args = 1 + (len + 4) / 4; /* with the terminating 0 */
+
+	r->event = LOG_STR;
+	r->nr_args = nr_args;
+	r->pid = 0;	/* not about any proc */
+	r->tick = get_ticks();
+	rec[sizeof(*r) / 4] = last_str_id;
+	rec[sizeof(*r) / 4 + nr_args - 1] = 0;	/* padding */
+	memcpy(&rec[sizeof(*r) / 4 + 1], (void*)s, len);
+	disklog_write(rec, sizeof(*r) + nr_args * 4);
+
+	return last_str_id;
+}